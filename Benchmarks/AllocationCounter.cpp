@@ -0,0 +1,76 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+// innermost counter of each thread, or nullptr
+thread_local ScopedAllocationCounter* activeCounter = nullptr;
+}
+
+ScopedAllocationCounter::ScopedAllocationCounter (std::atomic<int64>& total_)
+    : total (total_), enclosing (activeCounter)
+{
+    activeCounter = this;
+}
+
+ScopedAllocationCounter::~ScopedAllocationCounter()
+{
+    activeCounter = enclosing;
+
+    if (enclosing != nullptr)
+        enclosing->count += count;
+
+    total += count;
+}
+
+void ScopedAllocationCounter::countAllocation()
+{
+    if (activeCounter != nullptr)
+        activeCounter->count++;
+}
+
+// The array and nothrow forms call these by default, so every unaligned allocation is seen
+void* operator new (std::size_t size)
+{
+    ScopedAllocationCounter::countAllocation();
+
+    if (void* p = std::malloc (size == 0 ? 1 : size))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete (void* p) noexcept
+{
+    std::free (p);
+}
+
+void operator delete (void* p, std::size_t) noexcept
+{
+    std::free (p);
+}
@@ -0,0 +1,64 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef ALLOCATION_COUNTER_H_INCLUDED
+#define ALLOCATION_COUNTER_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include <atomic>
+
+/*
+	Counts the heap allocations made by the current thread while it is in scope,
+	and adds them to a total when it goes out of scope.
+
+	AllocationCounter.cpp replaces the global operator new with one that counts
+	for the innermost counter of the calling thread. Since that affects the
+	whole process, it is only linked into the test programs, never the plugin.
+*/
+class ScopedAllocationCounter
+{
+public:
+    /** Starts counting the calling thread's allocations into total */
+    explicit ScopedAllocationCounter (std::atomic<int64>& total);
+
+    /** Adds the allocations counted so far to the total, and to any enclosing counter */
+    ~ScopedAllocationCounter();
+
+    /** Returns the number of allocations counted so far */
+    int64 getCount() const { return count; }
+
+    /** Called by the replaced operator new for every allocation */
+    static void countAllocation();
+
+private:
+    std::atomic<int64>& total;
+
+    ScopedAllocationCounter* const enclosing;
+
+    int64 count = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (ScopedAllocationCounter);
+};
+
+#endif // ALLOCATION_COUNTER_H_INCLUDED
@@ -0,0 +1,241 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "AllocationCounter.h"
+#include "SpectrumRenderer.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+/*
+	Checks that the display path the plugin controls never allocates once it
+	is prepared: consuming power and coherence frames on the render thread
+	(CanvasPlot::render()), publishing the lines, and reading the lines and
+	spectrogram columns back on the message thread (CanvasPlot::updateDisplay()).
+	Plotting the lines with InteractivePlot and painting need the GUI, and both
+	allocate inside JUCE, so they are not covered.
+
+	Each display mode is fed the same fixed frames twice: once to warm up, then
+	with every allocation of the calling thread counted.
+
+	Built with the SPECTRUM_VIEWER_BENCHMARKS CMake option and run by ctest.
+	Returns 1 if anything allocates, or if nothing was produced to read.
+*/
+
+namespace
+{
+// 2 channels and their pair, 1000 displayed frequencies, 3 frames per call
+const int NUM_CHANNELS = 2;
+const int NUM_PAIRS = 1;
+const int NUM_FREQS = 1000;
+const int NUM_FRAMES = 3;
+
+/** Frame queues standing in for a SpectrumEngine's outputs */
+struct EngineOutputs
+{
+    std::vector<std::unique_ptr<FrameFifo>> power;
+    std::vector<std::unique_ptr<FrameFifo>> coherence;
+
+    EngineOutputs()
+    {
+        for (int i = 0; i < NUM_CHANNELS; i++)
+            power.push_back (std::make_unique<FrameFifo> (NUM_FRAMES, NUM_FREQS));
+
+        for (int i = 0; i < NUM_PAIRS; i++)
+            coherence.push_back (std::make_unique<FrameFifo> (NUM_FRAMES, NUM_FREQS));
+    }
+
+    /** Writes the same frames as every other call: a peak over a noise floor, and
+        one bin out of the log's domain */
+    void write()
+    {
+        for (int i = 0; i < NUM_CHANNELS; i++)
+        {
+            for (int f = 0; f < NUM_FRAMES; f++)
+            {
+                float* frame = power[i]->getWritePointer();
+
+                for (int n = 0; n < NUM_FREQS; n++)
+                    frame[n] = 10.0f + 1e4f / (1.0f + std::abs (n - 100 * (i + 1) - f));
+
+                frame[NUM_FREQS / 2] = 0.0f;
+                power[i]->finishedWrite();
+            }
+        }
+
+        for (int i = 0; i < NUM_PAIRS; i++)
+        {
+            for (int f = 0; f < NUM_FRAMES; f++)
+            {
+                float* frame = coherence[i]->getWritePointer();
+
+                for (int n = 0; n < NUM_FREQS; n++)
+                    frame[n] = (float) n / NUM_FREQS;
+
+                coherence[i]->finishedWrite();
+            }
+        }
+    }
+};
+
+/** What the message thread read back */
+struct Output
+{
+    int numLines = 0;
+    int numColumns = 0;
+    float checksum = 0.0f;
+};
+
+/** Does what CanvasPlot::render() does with the frames */
+void render (SpectrumRenderer& renderer, EngineOutputs& outputs)
+{
+    bool hasNewLines = false;
+
+    for (int i = 0; i < NUM_CHANNELS; i++)
+        hasNewLines = renderer.consumePower (i, *outputs.power[i]) || hasNewLines;
+
+    for (int i = 0; i < NUM_PAIRS; i++)
+        hasNewLines = renderer.consumeCoherence (i, *outputs.coherence[i]) || hasNewLines;
+
+    if (hasNewLines)
+        renderer.publishLines();
+}
+
+/** Does what CanvasPlot::updateDisplay() does before handing the lines to InteractivePlot */
+void updateDisplay (SpectrumRenderer& renderer, const uint32* colours, std::vector<uint32>& image, Output& output)
+{
+    for (int i = 0; i < NUM_CHANNELS; i++)
+    {
+        FrameQueue<uint8>& columns = renderer.getColumns (i);
+
+        while (const uint8* column = columns.getReadPointer())
+        {
+            for (int y = 0; y < columns.getFrameSize(); y++)
+                image[y] = colours[column[y]];
+
+            columns.finishedRead();
+            output.numColumns++;
+        }
+    }
+
+    if (renderer.getLines().hasUpdate())
+    {
+        AtomicScopedReadPtr<SpectrumRenderer::Lines> lines (renderer.getLines());
+
+        if (! lines.isValid())
+            return;
+
+        for (const auto& line : lines->values)
+            output.checksum += line[NUM_FREQS - 1];
+
+        output.numLines++;
+    }
+}
+} // namespace
+
+int main()
+{
+    const struct
+    {
+        const char* name;
+        SpectrumRenderer::Mode mode;
+        bool smoothOverTime;
+    } runs[] = {
+        { "power lines", SpectrumRenderer::POWER_LINES, true },
+        { "unsmoothed lines", SpectrumRenderer::POWER_LINES, false },
+        { "spectrogram", SpectrumRenderer::SPECTROGRAM_COLUMNS, true },
+        { "coherence lines", SpectrumRenderer::COHERENCE_LINES, true },
+    };
+
+    uint32 colours[SpectrumRenderer::SPECTROGRAM_LEVELS];
+
+    for (int i = 0; i < SpectrumRenderer::SPECTROGRAM_LEVELS; i++)
+        colours[i] = 0xff000000 | (uint32) i;
+
+    std::vector<uint32> image (NUM_FREQS);
+
+    EngineOutputs outputs;
+    SpectrumRenderer renderer;
+
+    bool passed = true;
+
+    // the counter itself has to see allocations for a count of 0 to mean anything
+    {
+        std::atomic<int64> total { 0 };
+
+        {
+            const ScopedAllocationCounter allocations (total);
+            ::operator delete (::operator new (16));
+        }
+
+        if (total != 1)
+        {
+            std::printf ("allocation counter saw %lld of 1 allocations   FAILED\n", (long long) total.load());
+            passed = false;
+        }
+    }
+
+    for (const auto& run : runs)
+    {
+        renderer.setMode (run.mode);
+        renderer.prepare (NUM_CHANNELS, NUM_PAIRS, NUM_FREQS, NUM_FREQS, run.smoothOverTime, run.smoothOverTime);
+
+        Output warmUp;
+
+        outputs.write();
+        render (renderer, outputs);
+        updateDisplay (renderer, colours, image, warmUp);
+
+        std::atomic<int64> total { 0 };
+        Output output;
+
+        outputs.write();
+
+        {
+            const ScopedAllocationCounter allocations (total);
+
+            render (renderer, outputs);
+            updateDisplay (renderer, colours, image, output);
+        }
+
+        const bool produced = run.mode == SpectrumRenderer::SPECTROGRAM_COLUMNS
+                                  ? output.numColumns == NUM_CHANNELS * NUM_FRAMES
+                                  : output.numLines == 1 && std::isfinite (output.checksum);
+
+        const bool ok = total == 0 && produced;
+
+        std::printf ("%-17s %lld allocations, %d lines, %d columns   %s\n",
+                     run.name,
+                     (long long) total.load(),
+                     output.numLines,
+                     output.numColumns,
+                     ok ? "ok" : "FAILED");
+
+        passed = passed && ok;
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "FrameNotifier.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#if JUCE_WINDOWS
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/*
+	Measures the CPU used by the FFT thread's scheduling while acquisition is
+	idle: a simulated audio thread delivers blocks of a 30 kHz stream, each
+	20 ms step is "computed" without any work, and the CPU time of the whole
+	process is sampled before and after.
+
+	"spin" is the loop the FFT thread used to run, polling the sample count
+	without sleeping. "notifier" is the current one, sleeping in
+	FrameNotifier::wait() until process() reports a completed step.
+
+	Built with the SPECTRUM_VIEWER_BENCHMARKS CMake option.
+*/
+
+namespace
+{
+const double SAMPLE_RATE = 30000.0;
+const int BLOCK_SIZE = 1024; // the GUI's default audio block
+const int STEP_SIZE = 600; // 20 ms
+const double SECONDS_PER_RUN = 5.0;
+
+/** Returns the user + system CPU time of the process so far, in seconds */
+double getProcessCpuSeconds()
+{
+#if JUCE_WINDOWS
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes (GetCurrentProcess(), &creation, &exit, &kernel, &user);
+
+    auto toSeconds = [] (FILETIME t) { return double ((uint64 (t.dwHighDateTime) << 32) | t.dwLowDateTime) * 1e-7; };
+    return toSeconds (kernel) + toSeconds (user);
+#else
+    rusage usage;
+    getrusage (RUSAGE_SELF, &usage);
+
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + 1e-6 * (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+#endif
+}
+
+/** Runs the audio and FFT threads for SECONDS_PER_RUN and returns the process CPU use, in % of one core */
+double measure (bool spin, int64& numSteps)
+{
+    std::atomic<int64> written { 0 };
+    std::atomic<bool> running { true };
+    FrameNotifier stepReady;
+
+    numSteps = 0;
+
+    std::thread fftThread ([&]
+    {
+        int64 nextWindowEnd = STEP_SIZE;
+
+        while (running.load())
+        {
+            if (! spin && ! stepReady.wait (100))
+                continue;
+
+            // compute the steps that are ready (no work while idle)
+            while (nextWindowEnd <= written.load())
+            {
+                nextWindowEnd += STEP_SIZE;
+                numSteps++;
+            }
+        }
+    });
+
+    using Clock = std::chrono::steady_clock;
+
+    const auto wallStart = Clock::now();
+    const double cpuStart = getProcessCpuSeconds();
+
+    // the audio thread: one block per block period, signalling when it completes a step
+    const auto blockPeriod = std::chrono::duration<double> (BLOCK_SIZE / SAMPLE_RATE);
+    auto nextBlock = wallStart;
+    int64 nextStep = STEP_SIZE;
+
+    while (Clock::now() - wallStart < std::chrono::duration<double> (SECONDS_PER_RUN))
+    {
+        nextBlock += std::chrono::duration_cast<Clock::duration> (blockPeriod);
+        std::this_thread::sleep_until (nextBlock);
+
+        const int64 total = written.fetch_add (BLOCK_SIZE) + BLOCK_SIZE;
+
+        if (total >= nextStep)
+        {
+            nextStep += ((total - nextStep) / STEP_SIZE + 1) * STEP_SIZE;
+            stepReady.signal();
+        }
+    }
+
+    const double cpuSeconds = getProcessCpuSeconds() - cpuStart;
+    const double wallSeconds = std::chrono::duration<double> (Clock::now() - wallStart).count();
+
+    running.store (false);
+    stepReady.signal();
+    fftThread.join();
+
+    return 100.0 * cpuSeconds / wallSeconds;
+}
+} // namespace
+
+int main()
+{
+    std::printf ("Idle FFT scheduling, %g kHz stream, %d-sample blocks, 20 ms steps, %g s per run\n\n", SAMPLE_RATE / 1000, BLOCK_SIZE, SECONDS_PER_RUN);
+
+    for (bool spin : { true, false })
+    {
+        int64 numSteps;
+        const double cpu = measure (spin, numSteps);
+
+        std::printf ("%-9s %6.2f %% of one core (%lld steps)\n", spin ? "spin" : "notifier", cpu, (long long) numSteps);
+    }
+
+    return 0;
+}
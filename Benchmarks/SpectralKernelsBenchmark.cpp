@@ -0,0 +1,218 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "SpectralKernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+/*
+	Times each SpectralKernels kernel against its scalar reference, at the
+	sizes the plugin uses, and checks the results against the documented bounds:
+	windowing and power are bit-identical to the reference, log is within
+	1 ulp of std::log and decibels within 6e-5 dB of 10 log10, over 1e-37 to 1e37.
+
+	Built with the SPECTRUM_VIEWER_BENCHMARKS CMake option. Returns 1 if any check fails.
+*/
+
+namespace
+{
+// A 2 s window at 7.5 kHz, its bins, and the bins of one displayed range
+const int WINDOW_SIZE = 15003;
+const int NUM_BINS = 7501;
+const int NUM_LOG_VALUES = 1500;
+
+const int MAX_LOG_ULP = 1;
+const float MAX_DECIBEL_ERROR = 6e-5f;
+
+/** Returns the best time of one call to fn, in microseconds */
+template <typename Function>
+double timeCall (Function fn)
+{
+    using Clock = std::chrono::steady_clock;
+
+    const int numCalls = 100;
+    double best = 1e30;
+
+    for (int run = 0; run < 20; run++)
+    {
+        const auto start = Clock::now();
+
+        for (int i = 0; i < numCalls; i++)
+            fn();
+
+        const std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+        best = std::min (best, elapsed.count() / numCalls);
+    }
+
+    return best;
+}
+
+/** Returns the number of floats between a and b, both finite */
+int64_t ulpDistance (float a, float b)
+{
+    int32_t ia, ib;
+    std::memcpy (&ia, &a, sizeof (float));
+    std::memcpy (&ib, &b, sizeof (float));
+
+    // map the sign-magnitude bit patterns onto a monotonic integer line
+    const int64_t la = ia < 0 ? int64_t (INT32_MIN) - ia : ia;
+    const int64_t lb = ib < 0 ? int64_t (INT32_MIN) - ib : ib;
+
+    return la > lb ? la - lb : lb - la;
+}
+
+template <typename T>
+bool isBitIdentical (const std::vector<T>& a, const std::vector<T>& b)
+{
+    return std::memcmp (a.data(), b.data(), a.size() * sizeof (T)) == 0;
+}
+
+bool report (const char* name, double referenceTime, double kernelTime, bool passed, const char* check)
+{
+    std::printf ("%-22s %9.2f us %9.2f us %7.1fx   %s (%s)\n", name, referenceTime, kernelTime, referenceTime / kernelTime, passed ? "ok" : "FAILED", check);
+    return passed;
+}
+} // namespace
+
+int main()
+{
+    std::mt19937 random (1);
+    std::uniform_real_distribution<float> uniform (-1.0f, 1.0f);
+    std::uniform_real_distribution<float> exponent (-37.0f, 37.0f);
+
+    std::vector<float> samples (WINDOW_SIZE), window (WINDOW_SIZE);
+
+    for (int n = 0; n < WINDOW_SIZE; n++)
+    {
+        samples[n] = 100.0f * uniform (random);
+        window[n] = 0.54f - 0.46f * std::cos (2.0f * 3.14159265f * n / (WINDOW_SIZE - 1));
+    }
+
+    std::vector<double> spectrum (2 * NUM_BINS);
+    std::vector<float> spectrumFloat (2 * NUM_BINS);
+
+    for (int k = 0; k < 2 * NUM_BINS; k++)
+    {
+        spectrum[k] = 1e4 * uniform (random);
+        spectrumFloat[k] = (float) spectrum[k];
+    }
+
+    // log-uniform over the whole range the kernels are specified for
+    std::vector<float> values (NUM_LOG_VALUES);
+
+    for (auto& value : values)
+        value = std::pow (10.0f, exponent (random));
+
+    std::printf ("Spectral kernels: %s\n\n", SpectralKernels::getInstructionSetName().toRawUTF8());
+    std::printf ("%-22s %12s %12s %8s\n", "kernel", "reference", "selected", "speedup");
+
+    bool passed = true;
+
+    {
+        std::vector<double> expected (WINDOW_SIZE), actual (WINDOW_SIZE);
+
+        const double referenceTime = timeCall ([&] { SpectralKernels::Reference::applyWindow (samples.data(), window.data(), expected.data(), WINDOW_SIZE); });
+        const double kernelTime = timeCall ([&] { SpectralKernels::applyWindow (samples.data(), window.data(), actual.data(), WINDOW_SIZE); });
+
+        passed &= report ("window (double)", referenceTime, kernelTime, isBitIdentical (expected, actual), "bit-identical");
+    }
+
+    {
+        std::vector<float> expected (WINDOW_SIZE), actual (WINDOW_SIZE);
+
+        const double referenceTime = timeCall ([&] { SpectralKernels::Reference::applyWindow (samples.data(), window.data(), expected.data(), WINDOW_SIZE); });
+        const double kernelTime = timeCall ([&] { SpectralKernels::applyWindow (samples.data(), window.data(), actual.data(), WINDOW_SIZE); });
+
+        passed &= report ("window (float)", referenceTime, kernelTime, isBitIdentical (expected, actual), "bit-identical");
+    }
+
+    {
+        std::vector<double> expected (NUM_BINS), actual (NUM_BINS);
+
+        const double referenceTime = timeCall ([&] { SpectralKernels::Reference::complexPower (spectrum.data(), expected.data(), NUM_BINS); });
+        const double kernelTime = timeCall ([&] { SpectralKernels::complexPower (spectrum.data(), actual.data(), NUM_BINS); });
+
+        // in place, as CumulativeTFR calls it
+        std::vector<double> inPlace (spectrum);
+        SpectralKernels::complexPower (inPlace.data(), inPlace.data(), NUM_BINS);
+        inPlace.resize (NUM_BINS);
+
+        passed &= report ("|X|^2 (double)", referenceTime, kernelTime, isBitIdentical (expected, actual) && isBitIdentical (expected, inPlace), "bit-identical");
+    }
+
+    {
+        std::vector<float> expected (NUM_BINS), actual (NUM_BINS);
+
+        const double referenceTime = timeCall ([&] { SpectralKernels::Reference::complexPower (spectrumFloat.data(), expected.data(), NUM_BINS); });
+        const double kernelTime = timeCall ([&] { SpectralKernels::complexPower (spectrumFloat.data(), actual.data(), NUM_BINS); });
+
+        std::vector<float> inPlace (spectrumFloat);
+        SpectralKernels::complexPower (inPlace.data(), inPlace.data(), NUM_BINS);
+        inPlace.resize (NUM_BINS);
+
+        passed &= report ("|X|^2 (float)", referenceTime, kernelTime, isBitIdentical (expected, actual) && isBitIdentical (expected, inPlace), "bit-identical");
+    }
+
+    {
+        std::vector<float> expected (NUM_LOG_VALUES), actual (NUM_LOG_VALUES);
+
+        const double referenceTime = timeCall ([&] { SpectralKernels::Reference::log (values.data(), expected.data(), NUM_LOG_VALUES); });
+        const double kernelTime = timeCall ([&] { SpectralKernels::log (values.data(), actual.data(), NUM_LOG_VALUES); });
+
+        int64_t maxUlp = 0;
+
+        for (int n = 0; n < NUM_LOG_VALUES; n++)
+            maxUlp = std::max (maxUlp, ulpDistance (actual[n], std::log (values[n])));
+
+        char check[64];
+        std::snprintf (check, sizeof (check), "%lld ulp of std::log", (long long) maxUlp);
+
+        passed &= report ("log", referenceTime, kernelTime, maxUlp <= MAX_LOG_ULP, check);
+    }
+
+    {
+        std::vector<float> expected (NUM_LOG_VALUES), actual (NUM_LOG_VALUES);
+
+        const double referenceTime = timeCall ([&] { SpectralKernels::Reference::decibels (values.data(), expected.data(), NUM_LOG_VALUES); });
+        const double kernelTime = timeCall ([&] { SpectralKernels::decibels (values.data(), actual.data(), NUM_LOG_VALUES); });
+
+        double maxError = 0;
+
+        for (int n = 0; n < NUM_LOG_VALUES; n++)
+            maxError = std::max (maxError, std::abs (actual[n] - 10.0 * std::log10 ((double) values[n])));
+
+        char check[64];
+        std::snprintf (check, sizeof (check), "%.1e dB of 10 log10", maxError);
+
+        passed &= report ("decibels", referenceTime, kernelTime, maxError <= MAX_DECIBEL_ERROR, check);
+    }
+
+    return passed ? 0 : 1;
+}
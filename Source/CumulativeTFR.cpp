@@ -20,122 +20,553 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 */
-// Hello
+
 #include "CumulativeTFR.h"
+#include "SpectralKernels.h"
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
-#define MS_FROM_START Time::highResolutionTicksToSeconds (Time::getHighResolutionTicks() - start) * 1000
-
-CumulativeTFR::CumulativeTFR (int nChans, int nf, int nt, int Fs, float winLen, float stepLen, float freqStep, int freqStart, double fftSec, double alpha)
-    : nFreqs (nf), Fs (Fs), stepLen (stepLen), nTimes (nt), nfft (int (fftSec * Fs)), alpha (alpha), freqStep (freqStep), freqStart (freqStart), windowLen (winLen), powBuffer (nChans, vector<vector<RealWeightedAccum>> (nf, vector<RealWeightedAccum> (nt, RealWeightedAccum (alpha))))
+CumulativeTFR::CumulativeTFR (int nChans, int nf, int nt, double Fs, int fftLen, int windowSize, float winLen, float stepLen, float freqStep, float freqStart, double alpha, const vector<std::pair<int, int>>& pairs, double coherenceAlpha, Method method, const vector<int>& slidingBins_, const vector<float>& constantQFreqs, int numWorkers)
+    : nChans (nChans), channelsPerBatch (jlimit (1, MAX_CHANNELS_PER_BATCH, (nChans + jmax (1, numWorkers) - 1) / jmax (1, numWorkers))), nFreqs (nf), Fs (Fs), fftLen (fftLen), windowSize (windowSize), stepLen (stepLen), nTimes (nt), alpha (alpha), coherenceAlpha (coherenceAlpha), pairs (pairs), nPairs ((int) pairs.size()), freqStep (freqStep), freqStart (freqStart), windowLen (winLen), method (method)
 {
-    //std::cout << "Creating new TFR" << std::endl;
-    // std::cout << "PARAMS:" << std::endl;
-    //std::cout << "nFreqs: " << nFreqs << std::endl;
-    // std::cout << "Fs: " << Fs << std::endl;
-    // std::cout << "stepLen: " << stepLen << std::endl;
-    // std::cout << "nTimes: " << nTimes << std::endl;
-    // std::cout << "nfft: " << nfft << std::endl;
-    // std::cout << "alpha: " << alpha << std::endl;
-    //std::cout << "freqStep: " << freqStep << std::endl;
-    // std::cout << "freqStart: " << freqStart << std::endl;
-    // std::cout << "windowLen: " << windowLen << std::endl;
+    firstBin = roundToInt (freqStart / freqStep);
+
+    if (method == WAVELET)
+    {
+        vector<float> frequencies;
+
+        for (int freq = 0; freq < nFreqs; freq++)
+            frequencies.push_back (freqStart + freq * freqStep);
+
+        wavelets = getWaveletBank (Fs, fftLen, windowSize, frequencies, WAVELET_CYCLES);
+    }
+
+    if (method == CONSTANT_Q)
+    {
+        jassert ((int) constantQFreqs.size() == nFreqs);
+
+        // Q cycles make each wavelet's bandwidth the spacing of the frequencies, f (2^(1 / B) - 1)
+        const double cycles = 1.0 / (std::pow (2.0, 1.0 / CONSTANT_Q_BINS_PER_OCTAVE) - 1);
+
+        wavelets = getWaveletBank (Fs, fftLen, windowSize, constantQFreqs, cycles);
+    }
+
+    if (method == MULTITAPER)
+        tapers = getTapers (windowSize);
+
+    rowsPerChannel = tapers != nullptr ? NUM_TAPERS : 1;
+
+    segmentLen = 0;
+
+    if (method == WELCH)
+    {
+        // half-overlapping segments of an even length, so that every hop is whole
+        segmentLen = jmax (2, (windowSize / WELCH_SEGMENTS_PER_WINDOW) & ~1);
+        segmentHop = segmentLen / 2;
+        segmentCapacity = (windowSize - segmentLen) / segmentHop + 2;
+
+        const double gain = std::sqrt (double (windowSize) / segmentLen);
+
+        for (int n = 0; n < segmentLen; n++)
+            segmentWindow.push_back (SpectrumSample (gain * (0.54 - 0.46 * std::cos (2 * double_Pi * n / segmentLen))));
 
-    // std::cout << "Creating waveletArray" << std::endl;
+        segmentBins = 1;
 
-    // vector<vector<std::complex<double>>> wv(nf, vector<std::complex<double>>(nfft));
+        for (int freq = 0; freq < nFreqs; freq++)
+        {
+            const double position = double (firstBin + freq) * segmentLen / fftLen;
+            segmentBinBelow.push_back (int (position));
+            segmentBinFraction.push_back (SpectrumSample (position - int (position)));
+            segmentBins = jmax (segmentBins, int (position) + 2);
+        }
+
+        segmentBins = jmin (segmentBins, segmentLen / 2 + 1);
+
+        // the highest displayed frequencies may fall beyond the last segment bin
+        for (int freq = 0; freq < nFreqs; freq++)
+        {
+            if (segmentBinBelow[freq] >= segmentBins - 1)
+            {
+                segmentBinBelow[freq] = segmentBins - 1;
+                segmentBinFraction[freq] = 0;
+            }
+        }
+
+        lastSegment.assign (nChans, -1);
+        welchEnd.assign (nChans, 0);
+    }
+
+    if (method == SLIDING_DFT)
+    {
+        // the recursion only holds for bins of the window itself
+        jassert (fftLen == windowSize);
+
+        for (int bin : slidingBins_)
+        {
+            if (bin >= 0 && bin < nFreqs && firstBin + bin <= fftLen / 2)
+                slidingBins.push_back (bin);
+        }
+
+        std::sort (slidingBins.begin(), slidingBins.end());
+        slidingBins.erase (std::unique (slidingBins.begin(), slidingBins.end()), slidingBins.end());
+
+        for (int bin : slidingBins)
+        {
+            for (int neighbour = firstBin + bin - 1; neighbour <= firstBin + bin + 1; neighbour++)
+            {
+                if (trackedBins.empty() || trackedBins.back() < neighbour)
+                    trackedBins.push_back (neighbour);
+            }
+
+            trackedIndex.push_back ((int) trackedBins.size() - 2);
+        }
 
-    // waveletArray = wv;
+        for (int bin : trackedBins)
+        {
+            trackedCos.push_back (std::cos (2 * double_Pi * bin / fftLen));
+            trackedSin.push_back (std::sin (2 * double_Pi * bin / fftLen));
+        }
 
-    // std::cout << "Creating spectrum buffer" << std::endl;
+        slidingEnd.assign (nChans, -1);
+    }
 
-    // vector<vector<vector<std::complex<double>>>> specBuff(ng1 + ng2,
-    // 	vector<vector<std::complex<double>>>(nf,
-    // 		vector<std::complex<double>>(nt)));
+    // Room for fftLen / 2 + 1 complex outputs, padded so every batch has the same alignment
+    const int rowAlignment = 64 / sizeof (SpectrumSample);
+    rowStride = (2 * (fftLen / 2 + 1) + rowAlignment - 1) & ~(rowAlignment - 1);
+    fftData = SPECTRUM_FFTW (alloc_real) ((size_t) jmax (1, nChans) * rowsPerChannel * rowStride);
 
-    // spectrumBuffer = specBuff;
+    const int lastBatchSize = nChans % channelsPerBatch;
 
-    // std::cout << "Generating wavelets" << std::endl;
+    // the sliding DFT only uses the rows to hold samples, and Welch to transform one segment at a time
+    if (method == WELCH)
+    {
+        segmentPlan = FFTWPlanner::getInstance().planBatch (segmentLen, 1, rowStride, fftData);
+    }
+    else if (method != SLIDING_DFT)
+    {
+        batchPlan = createBatchPlan (jmin (nChans, channelsPerBatch), fftData);
 
-    // // Create array of wavelets
-    // generateWavelet();
+        if (nChans > channelsPerBatch && lastBatchSize > 0)
+            lastBatchPlan = createBatchPlan (lastBatchSize, getInputRow (nChans - lastBatchSize));
+    }
 
-    // // Trim time close to edge
-    // trimTime = windowLen / 2;
+    FloatVectorOperations::clear (fftData, (size_t) jmax (1, nChans) * rowsPerChannel * rowStride);
+
+    // One allocation for all averages, each array padded to a whole number of cache lines
+    auto padded = [] (size_t bytes) { return (bytes + 63) & ~(size_t) 63; };
+
+    const int nCohChans = nPairs > 0 ? nChans : 0;
+    const int nWaveletChans = wavelets != nullptr ? nChans : 0;
+    const int maxTaps = wavelets != nullptr ? wavelets->maxTaps : 0;
+    const int nCoefChans = (wavelets != nullptr || method == SLIDING_DFT) ? nChans : 0;
+
+    const size_t powSumBytes = padded ((size_t) nChans * nTimes * nFreqs * sizeof (SpectrumSample));
+    const size_t cohPowSumBytes = padded ((size_t) nCohChans * nTimes * nFreqs * sizeof (SpectrumSample));
+    const size_t pxySumBytes = padded ((size_t) nPairs * nTimes * nFreqs * sizeof (SpectrumSample));
+    const size_t powerFrameBytes = padded ((size_t) getNumBatches() * nFreqs * sizeof (SpectrumSample));
+    const size_t waveletTailBytes = padded ((size_t) nWaveletChans * maxTaps * sizeof (SpectrumSample));
+    const size_t coefBytes = padded ((size_t) nCoefChans * 2 * nFreqs * sizeof (SpectrumSample));
+    const size_t powWeightBytes = padded ((size_t) nChans * nTimes * sizeof (double));
+    const size_t cohPowWeightBytes = padded ((size_t) nCohChans * nTimes * sizeof (double));
+    const size_t pxyWeightBytes = padded ((size_t) nPairs * nTimes * sizeof (double));
+    const size_t slidingStateBytes = padded ((size_t) nChans * trackedBins.size() * sizeof (double));
+    const size_t segmentSpectraBytes = padded ((size_t) nChans * segmentCapacity * 2 * segmentBins * sizeof (SpectrumSample));
+    const size_t segmentSumBytes = padded ((size_t) (method == WELCH ? getNumBatches() + 2 : 0) * segmentBins * sizeof (SpectrumSample));
+    const size_t totalBytes = powSumBytes + cohPowSumBytes + 2 * pxySumBytes + powerFrameBytes + waveletTailBytes + coefBytes + powWeightBytes + cohPowWeightBytes + pxyWeightBytes + 2 * slidingStateBytes + segmentSpectraBytes + segmentSumBytes;
+
+    accumulatorMemory = SPECTRUM_FFTW (malloc) (jmax ((size_t) 64, totalBytes));
+    zeromem (accumulatorMemory, totalBytes);
+
+    char* block = static_cast<char*> (accumulatorMemory);
+    powSums = reinterpret_cast<SpectrumSample*> (block);
+    block += powSumBytes;
+    cohPowSums = reinterpret_cast<SpectrumSample*> (block);
+    block += cohPowSumBytes;
+    pxyRealSums = reinterpret_cast<SpectrumSample*> (block);
+    block += pxySumBytes;
+    pxyImagSums = reinterpret_cast<SpectrumSample*> (block);
+    block += pxySumBytes;
+    powerFrames = reinterpret_cast<SpectrumSample*> (block);
+    block += powerFrameBytes;
+    waveletTails = reinterpret_cast<SpectrumSample*> (block);
+    block += waveletTailBytes;
+    coefficients = reinterpret_cast<SpectrumSample*> (block);
+    block += coefBytes;
+    powWeights = reinterpret_cast<double*> (block);
+    block += powWeightBytes;
+    cohPowWeights = reinterpret_cast<double*> (block);
+    block += cohPowWeightBytes;
+    pxyWeights = reinterpret_cast<double*> (block);
+    block += pxyWeightBytes;
+    slidingReal = reinterpret_cast<double*> (block);
+    block += slidingStateBytes;
+    slidingImag = reinterpret_cast<double*> (block);
+    block += slidingStateBytes;
+    segmentSpectra = reinterpret_cast<SpectrumSample*> (block);
+    block += segmentSpectraBytes;
+    segmentSums = reinterpret_cast<SpectrumSample*> (block);
 }
 
-void CumulativeTFR::computeFFT (FFTWArrayType& fftBuffer, int channelIndex)
+CumulativeTFR::~CumulativeTFR()
 {
-    // auto start = Time::getHighResolutionTicks();
-    fftBuffer.fftReal(); // perform fft
+    SPECTRUM_FFTW (free) (fftData);
+    SPECTRUM_FFTW (free) (accumulatorMemory);
+}
 
-    // std::cout << "fftBuffer.REAL(): " << MS_FROM_START << std::endl;
+void CumulativeTFR::accumulate (SpectrumSample* sums, const SpectrumSample* frame, double alpha) const
+{
+    const SpectrumSample decay = SpectrumSample (1 - alpha);
 
-    // Compute the power (square of the absolute value of the fft buffer)
     for (int freq = 0; freq < nFreqs; freq++)
+        sums[freq] = frame[freq] + decay * sums[freq];
+}
+
+std::shared_ptr<FFTWPlanner::BatchPlan> CumulativeTFR::createBatchPlan (int numChannels, SpectrumSample* firstRow)
+{
+    if (numChannels <= 0 || fftLen <= 0)
+        return nullptr;
+
+    return FFTWPlanner::getInstance().planBatch (fftLen, numChannels * rowsPerChannel, rowStride, firstRow);
+}
+
+void CumulativeTFR::computeFFT (int batchIndex)
+{
+    const int firstChannel = batchIndex * channelsPerBatch;
+    const int numChannels = jmin (channelsPerBatch, nChans - firstChannel);
+
+    FFTWPlanner::BatchPlan* batch = (numChannels == channelsPerBatch || lastBatchPlan == nullptr) ? batchPlan.get() : lastBatchPlan.get();
+
+    if (batch == nullptr)
+        return;
+
+    FFTWPlanner::Plan plan = batch->get();
+
+    // short wavelets are applied to the samples themselves, which the transform overwrites
+    if (wavelets != nullptr && wavelets->maxTaps > 0)
+    {
+        const int maxTaps = wavelets->maxTaps;
+
+        for (int ch = firstChannel; ch < firstChannel + numChannels; ch++)
+            FloatVectorOperations::copy (waveletTails + (size_t) ch * maxTaps, getInputRow (ch) + windowSize - maxTaps, maxTaps);
+    }
+
+    // the transform overwrote the padding of the previous step, and the tapers only fill windowSize samples
+    if (fftLen > windowSize)
+    {
+        for (int ch = firstChannel; ch < firstChannel + numChannels; ch++)
+        {
+            for (int row = 0; row < rowsPerChannel; row++)
+                FloatVectorOperations::clear (getInputRow (ch) + (size_t) row * rowStride + windowSize, fftLen - windowSize);
+        }
+    }
+
+    if (tapers != nullptr)
     {
-        powBuffer[channelIndex][freq][0].reset();
-        powBuffer[channelIndex][freq][0].addValue (square (std::abs (fftBuffer.getAsComplex (freq))));
+        for (int ch = firstChannel; ch < firstChannel + numChannels; ch++)
+            applyTapers (ch);
+    }
+
+    // perform all ffts of the batch at once, including every tapered copy
+    SpectrumSample* firstRow = getInputRow (firstChannel);
+    SPECTRUM_FFTW (execute_dft_r2c) (plan, firstRow, reinterpret_cast<FFTWPlanner::Complex*> (firstRow));
+
+    // Compute the power (square of the absolute value of the fft buffer),
+    // keeping the spectrum itself for the cross-spectra
+    SpectrumSample* power = powerFrames + (size_t) batchIndex * nFreqs;
+
+    for (int ch = firstChannel; ch < firstChannel + numChannels; ch++)
+    {
+        if (wavelets != nullptr)
+            applyWavelets (ch);
+
+        if (tapers != nullptr)
+            taperedPower (ch, power);
+        else
+            SpectralKernels::complexPower (getSpectrum (ch), power, nFreqs);
+
+        accumulatePower (ch, power);
     }
 }
 
-void CumulativeTFR::getMeanCoherence (int itX, int itY, AtomicallyShared<std::vector<double>>& coherence, int comb)
+void CumulativeTFR::accumulatePower (int channelIndex, const SpectrumSample* power)
 {
-    AtomicScopedWritePtr<std::vector<double>> dataWriter (coherence);
+    const int ch = channelIndex;
 
-    // Cross spectra
-    for (int f = 0; f < nFreqs; ++f)
+    accumulate (getSums (powSums, ch, 0), power, alpha);
+    powWeights[ch * nTimes] = 1 + (1 - alpha) * powWeights[ch * nTimes];
+
+    if (nPairs > 0)
     {
-        // Get crss from specturm of both chanX and chanY
-        for (int t = 0; t < nTimes; t++)
+        accumulate (getSums (cohPowSums, ch, 0), power, coherenceAlpha);
+        cohPowWeights[ch * nTimes] = 1 + (1 - coherenceAlpha) * cohPowWeights[ch * nTimes];
+    }
+}
+
+int CumulativeTFR::getSlideLength (int channelIndex, int64 windowEnd) const
+{
+    const int64 end = slidingEnd[channelIndex];
+
+    // the new and the leaving samples must both fit in the input row, otherwise restarting is cheaper anyway
+    if (end < 0 || windowEnd <= end || 2 * (windowEnd - end) > rowStride)
+        return 0;
+
+    return int (windowEnd - end);
+}
+
+void CumulativeTFR::slideWindow (int channelIndex, int64 windowEnd, const SpectrumSample* incoming, const SpectrumSample* outgoing, int numSamples)
+{
+    const int numTracked = (int) trackedBins.size();
+
+    double* re = slidingReal + (size_t) channelIndex * numTracked;
+    double* im = slidingImag + (size_t) channelIndex * numTracked;
+
+    // restart from an empty window, so no samples leave while the whole window comes in
+    if (outgoing == nullptr)
+    {
+        std::fill (re, re + numTracked, 0.0);
+        std::fill (im, im + numTracked, 0.0);
+    }
+
+    // X[k] <- (X[k] + x_in - x_out) exp (2 pi i k / fftLen), which keeps the phase relative to the window start
+    for (int n = 0; n < numSamples; n++)
+    {
+        const double delta = outgoing != nullptr ? double (incoming[n]) - double (outgoing[n]) : double (incoming[n]);
+
+        for (int b = 0; b < numTracked; b++)
         {
-            std::complex<double> crss = spectrumBuffer[itX][f][t] * std::conj (spectrumBuffer[itY][f][t]);
-            pxys[comb][f][t].addValue (crss);
+            const double r = re[b] + delta;
+            const double i = im[b];
+
+            re[b] = r * trackedCos[b] - i * trackedSin[b];
+            im[b] = r * trackedSin[b] + i * trackedCos[b];
         }
     }
 
-    // Coherence
-    for (int f = 0; f < nFreqs; ++f)
+    slidingEnd[channelIndex] = windowEnd;
+
+    // Hamming window applied in the frequency domain
+    SpectrumSample* coefs = coefficients + (size_t) channelIndex * 2 * nFreqs;
+
+    for (int i = 0; i < (int) slidingBins.size(); i++)
     {
-        // compute coherence at each time
-        RealAccum coh;
+        const int t = trackedIndex[i];
+        const int bin = slidingBins[i];
+
+        coefs[2 * bin] = SpectrumSample (0.54 * re[t] - 0.23 * (re[t - 1] + re[t + 1]));
+        coefs[2 * bin + 1] = SpectrumSample (0.54 * im[t] - 0.23 * (im[t - 1] + im[t + 1]));
+    }
+
+    SpectrumSample* power = powerFrames + (size_t) (channelIndex / channelsPerBatch) * nFreqs;
+
+    SpectralKernels::complexPower (coefs, power, nFreqs);
+
+    accumulatePower (channelIndex, power);
+}
+
+void CumulativeTFR::getWindowSegments (int64 windowEnd, int64& first, int64& last) const
+{
+    first = (jmax ((int64) 0, windowEnd - windowSize) + segmentHop - 1) / segmentHop;
+    last = jmax ((int64) -1, windowEnd - segmentLen) / segmentHop;
+}
+
+int64 CumulativeTFR::getNextSegment (int channelIndex, int64 windowEnd) const
+{
+    int64 first, last;
+    getWindowSegments (windowEnd, first, last);
+
+    const int64 next = jmax (first, lastSegment[channelIndex] + 1);
+
+    return next <= last ? next * segmentHop : -1;
+}
+
+void CumulativeTFR::addSegment (int channelIndex, int64 segmentStart)
+{
+    SpectrumSample* row = getInputRow (channelIndex);
+
+    FloatVectorOperations::multiply (row, segmentWindow.data(), segmentLen);
 
-        for (int t = 0; t < nTimes; t++)
+    SPECTRUM_FFTW (execute_dft_r2c) (segmentPlan->get(), row, reinterpret_cast<FFTWPlanner::Complex*> (row));
+
+    // only the bins up to the highest displayed frequency are kept
+    const int64 segment = segmentStart / segmentHop;
+    FloatVectorOperations::copy (getSegmentSpectrum (channelIndex, segment), row, 2 * segmentBins);
+
+    lastSegment[channelIndex] = segment;
+}
+
+bool CumulativeTFR::hasWelchWindow (int channelIndex) const
+{
+    int64 first, last;
+    getWindowSegments (welchEnd[channelIndex], first, last);
+
+    return first <= last && lastSegment[channelIndex] >= last;
+}
+
+void CumulativeTFR::computeWelch (int batchIndex, int64 windowEnd)
+{
+    const int firstChannel = batchIndex * channelsPerBatch;
+    const int numChannels = jmin (channelsPerBatch, nChans - firstChannel);
+
+    SpectrumSample* sums = segmentSums + (size_t) batchIndex * segmentBins;
+    SpectrumSample* power = powerFrames + (size_t) batchIndex * nFreqs;
+
+    int64 first, last;
+    getWindowSegments (windowEnd, first, last);
+
+    const SpectrumSample scale = SpectrumSample (1.0 / jmax ((int64) 1, last - first + 1));
+
+    for (int ch = firstChannel; ch < firstChannel + numChannels; ch++)
+    {
+        welchEnd[ch] = windowEnd;
+
+        if (! hasWelchWindow (ch))
+            continue;
+
+        // mean power of the segments, then interpolated to the displayed frequencies
+        FloatVectorOperations::clear (sums, segmentBins);
+
+        for (int64 segment = first; segment <= last; segment++)
         {
-            coh.addValue (singleCoherence (
-                powBuffer[itX][f][t].getAverage(),
-                powBuffer[itY][f][t].getAverage(),
-                pxys[comb][f][t].getAverage()));
+            const SpectrumSample* spectrum = getSegmentSpectrum (ch, segment);
+
+            for (int bin = 0; bin < segmentBins; bin++)
+                sums[bin] += spectrum[2 * bin] * spectrum[2 * bin] + spectrum[2 * bin + 1] * spectrum[2 * bin + 1];
         }
 
-        dataWriter->assign (f, coh.getAverage());
+        for (int freq = 0; freq < nFreqs; freq++)
+            power[freq] = scale * interpolateSegmentBins (sums, freq);
 
-        if (nTimes < 2)
+        accumulatePower (ch, power);
+    }
+}
+
+void CumulativeTFR::computeCrossSpectrum (int pairIndex)
+{
+    if (method == WELCH)
+    {
+        computeWelchCrossSpectrum (pairIndex);
+        return;
+    }
+
+    SpectrumSample* realSums = getSums (pxyRealSums, pairIndex, 0);
+    SpectrumSample* imagSums = getSums (pxyImagSums, pairIndex, 0);
+
+    const SpectrumSample decay = SpectrumSample (1 - coherenceAlpha);
+
+    // x * conj (y), accumulated (decayed once, then summed over the tapers in MULTITAPER mode)
+    for (int taper = 0; taper < rowsPerChannel; taper++)
+    {
+        const SpectrumSample* x = getSpectrum (pairs[pairIndex].first) + (size_t) taper * rowStride;
+        const SpectrumSample* y = getSpectrum (pairs[pairIndex].second) + (size_t) taper * rowStride;
+
+        const SpectrumSample oldWeight = taper == 0 ? decay : SpectrumSample (1);
+
+        for (int freq = 0; freq < nFreqs; freq++)
         {
-            dataWriter->assign (f, 0);
+            const SpectrumSample xr = x[2 * freq];
+            const SpectrumSample xi = x[2 * freq + 1];
+            const SpectrumSample yr = y[2 * freq];
+            const SpectrumSample yi = y[2 * freq + 1];
+
+            realSums[freq] = (xr * yr + xi * yi) + oldWeight * realSums[freq];
+            imagSums[freq] = (xi * yr - xr * yi) + oldWeight * imagSums[freq];
         }
-        else
+    }
+
+    pxyWeights[pairIndex * nTimes] = 1 + (1 - coherenceAlpha) * pxyWeights[pairIndex * nTimes];
+}
+
+void CumulativeTFR::computeWelchCrossSpectrum (int pairIndex)
+{
+    const int chanX = pairs[pairIndex].first;
+    const int chanY = pairs[pairIndex].second;
+
+    if (! hasWelchWindow (chanX) || ! hasWelchWindow (chanY))
+        return;
+
+    int64 first, last;
+    getWindowSegments (welchEnd[chanX], first, last);
+
+    // x * conj (y), averaged over the segments on their own frequency grid
+    SpectrumSample* segmentReal = segmentSums + (size_t) getNumBatches() * segmentBins;
+    SpectrumSample* segmentImag = segmentReal + segmentBins;
+
+    FloatVectorOperations::clear (segmentReal, 2 * segmentBins);
+
+    for (int64 segment = first; segment <= last; segment++)
+    {
+        const SpectrumSample* x = getSegmentSpectrum (chanX, segment);
+        const SpectrumSample* y = getSegmentSpectrum (chanY, segment);
+
+        for (int bin = 0; bin < segmentBins; bin++)
         {
-            dataWriter->assign (f, std::sqrt (coh.getVariance() * nTimes / (nTimes - 1)));
+            segmentReal[bin] += x[2 * bin] * y[2 * bin] + x[2 * bin + 1] * y[2 * bin + 1];
+            segmentImag[bin] += x[2 * bin + 1] * y[2 * bin] - x[2 * bin] * y[2 * bin + 1];
         }
     }
 
-    dataWriter.pushUpdate();
+    SpectrumSample* realSums = getSums (pxyRealSums, pairIndex, 0);
+    SpectrumSample* imagSums = getSums (pxyImagSums, pairIndex, 0);
+
+    const SpectrumSample decay = SpectrumSample (1 - coherenceAlpha);
+    const SpectrumSample scale = SpectrumSample (1.0 / (last - first + 1));
+
+    for (int freq = 0; freq < nFreqs; freq++)
+    {
+        realSums[freq] = scale * interpolateSegmentBins (segmentReal, freq) + decay * realSums[freq];
+        imagSums[freq] = scale * interpolateSegmentBins (segmentImag, freq) + decay * imagSums[freq];
+    }
+
+    pxyWeights[pairIndex * nTimes] = 1 + (1 - coherenceAlpha) * pxyWeights[pairIndex * nTimes];
 }
 
-void CumulativeTFR::getPower (std::vector<float>& power, int channelIndex)
+void CumulativeTFR::getCoherence (float* coherence, int pairIndex)
 {
-    //std::cout << "Getting power." << std::endl;
+    const int chanX = pairs[pairIndex].first;
+    const int chanY = pairs[pairIndex].second;
 
-    //AtomicScopedWritePtr<std::vector<std::vector<float>>> dataWriter(power);
+    const SpectrumSample* pxxSums = getSums (cohPowSums, chanX, 0);
+    const SpectrumSample* pyySums = getSums (cohPowSums, chanY, 0);
+    const SpectrumSample* realSums = getSums (pxyRealSums, pairIndex, 0);
+    const SpectrumSample* imagSums = getSums (pxyImagSums, pairIndex, 0);
 
-    //int numChans = powBuffer.size();
-    //int numFreqs = powBuffer[0].size();
-    //int numTimes = powBuffer[0][0].size();
+    const double pxxWeight = cohPowWeights[chanX * nTimes];
+    const double pyyWeight = cohPowWeights[chanY * nTimes];
+    const double pxyWeight = pxyWeights[pairIndex * nTimes];
 
-    for (int frq = 0; frq < power.size(); ++frq)
+    if (pxxWeight <= 0 || pyyWeight <= 0 || pxyWeight <= 0)
     {
-        power[frq] = (float) powBuffer[channelIndex][frq][0].getAverage();
+        FloatVectorOperations::clear (coherence, nFreqs);
+        return;
+    }
+
+    for (int frq = 0; frq < nFreqs; ++frq)
+    {
+        const double pxx = pxxSums[frq] / pxxWeight;
+        const double pyy = pyySums[frq] / pyyWeight;
+        const std::complex<double> pxy (realSums[frq] / pxyWeight, imagSums[frq] / pxyWeight);
+
+        coherence[frq] = (pxx > 0 && pyy > 0) ? (float) singleCoherence (pxx, pyy, pxy) : 0.0f;
+    }
+}
+
+void CumulativeTFR::getPower (float* power, int channelIndex)
+{
+    const SpectrumSample* sums = getSums (powSums, channelIndex, 0);
+    const double weight = powWeights[channelIndex * nTimes];
+
+    if (weight <= 0)
+    {
+        FloatVectorOperations::clear (power, nFreqs);
+        return;
+    }
+
+    const SpectrumSample scale = SpectrumSample (1 / weight);
+
+    for (int frq = 0; frq < nFreqs; ++frq)
+    {
+        power[frq] = (float) (sums[frq] * scale);
     }
 }
 
@@ -146,89 +577,446 @@ double CumulativeTFR::singleCoherence (double pxx, double pyy, std::complex<doub
     return std::norm (pxy) / (pxx * pyy);
 }
 
-void CumulativeTFR::generateWavelet()
+std::vector<float> CumulativeTFR::getConstantQFrequencies (float lowest, float highest)
 {
-    std::vector<double> hann (nfft);
-    std::vector<double> sinWave (nfft);
-    std::vector<double> cosWave (nfft);
+    vector<float> frequencies;
 
-    waveletArray.resize (nFreqs);
+    if (lowest <= 0)
+        return frequencies;
+
+    // computed from the lowest frequency every time, so the top frequency does not drift
+    for (int k = 0;; k++)
+    {
+        const float hz = float (lowest * std::pow (2.0, double (k) / CONSTANT_Q_BINS_PER_OCTAVE));
+
+        if (hz > highest * 1.0001f)
+            break;
+
+        frequencies.push_back (hz);
+    }
+
+    return frequencies;
+}
+
+std::shared_ptr<const CumulativeTFR::WaveletBank> CumulativeTFR::getWaveletBank (double Fs, int fftLen, int windowSize, const vector<float>& frequencies, double cycles)
+{
+    using Key = std::tuple<double, int, int, double, vector<float>>;
 
-    // Hann window
+    // a few banks are kept so that switching back to a recent range does not regenerate them
+    const size_t maxUnusedBanks = 4;
 
-    float nSampWindow = Fs * windowLen;
+    static CriticalSection cacheLock;
+    static std::map<Key, std::shared_ptr<const WaveletBank>> cache;
 
-    std::cout << "Wavelet frequency: " << Fs << std::endl;
-    std::cout << "nSampWindow : " << nSampWindow << std::endl;
-    std::cout << "nfft: " << nfft << std::endl;
-    std::cout << "freqStart: " << freqStart << std::endl;
-    std::cout << "freqStep: " << freqStep << std::endl;
+    const ScopedLock lock (cacheLock);
 
-    //std::cout << "Hann window: " << std::endl;
+    const Key key (Fs, fftLen, windowSize, cycles, frequencies);
+    auto cached = cache.find (key);
 
-    for (int position = 0; position < nfft; position++)
+    if (cached != cache.end())
+        return cached->second;
+
+    if (cache.size() >= maxUnusedBanks)
+    {
+        for (auto it = cache.begin(); it != cache.end();)
+            it = it->second.use_count() == 1 ? cache.erase (it) : std::next (it);
+    }
+
+    auto bank = generateWavelet (Fs, fftLen, windowSize, frequencies, cycles);
+    cache[key] = bank;
+
+    return bank;
+}
+
+std::shared_ptr<const CumulativeTFR::WaveletBank> CumulativeTFR::generateWavelet (double Fs, int fftLen, int windowSize, const vector<float>& frequencies, double cycles)
+{
+    using Complex = std::complex<double>;
+
+    const int nFreqs = (int) frequencies.size();
+
+    auto bank = std::make_shared<WaveletBank>();
+
+    bank->firstBin.assign (nFreqs, 0);
+    bank->numBins.assign (nFreqs, 0);
+    bank->binOffset.assign (nFreqs, 0);
+    bank->numTaps.assign (nFreqs, 0);
+    bank->tapOffset.assign (nFreqs, 0);
+
+    const int N = fftLen;
+    const int W = jmin (windowSize, fftLen);
+    const double twoPi = 2 * double_Pi;
+
+    // Sum of exp (i beta j) for j = 0 .. L - 1
+    auto dirichlet = [] (double beta, int L) -> Complex
     {
-        //// Hann Window //// = sin^2(PI*n/N) where N=length of window
-        // Create first half hann function
-        if (position <= nSampWindow / 2)
+        beta = std::remainder (beta, 2 * double_Pi);
+        const double s = std::sin (beta / 2);
+
+        if (std::abs (s) < 1e-12)
+            return Complex (L, 0);
+
+        return std::polar (std::sin (beta * L / 2) / s, beta * (L - 1) / 2);
+    };
+
+    for (int freq = 0; freq < nFreqs && N > 0; freq++)
+    {
+        const double hz = frequencies[freq];
+
+        // Wavelet: w[j] = gain * hann[j] * exp (-i theta j), applied to the last L samples of the window.
+        // The gain gives a sinusoid the same power as a Hamming-windowed periodogram of the whole window.
+        const int L = hz > 0 ? jlimit (1, W, int (std::round (cycles * Fs / hz))) : W;
+        const double theta = twoPi * hz / Fs;
+        const double gamma = twoPi / L;
+        const double gain = 0.54 * W / (L > 1 ? 0.5 * L : 1.0);
+
+        const double centre = hz * N / Fs;
+        const double halfWidth = WAVELET_SUPPORT * double (N) / L;
+        const int first = jmax (0, int (std::floor (centre - halfWidth)));
+        const int last = jmin (N / 2, int (std::ceil (centre + halfWidth)));
+        const int numBins = last - first + 1;
+
+        // a kernel bin costs about twice as much as a tap
+        if (numBins > 0 && 2 * numBins < L)
+        {
+            bank->firstBin[freq] = first;
+            bank->numBins[freq] = numBins;
+            bank->binOffset[freq] = (int) bank->binWeights.size() / 4;
+
+            // Sum of hann[j] exp (i beta j), with hann[j] = 0.5 - 0.5 cos (gamma (j + 0.5))
+            auto hannSum = [&] (double beta) -> Complex
+            {
+                return 0.5 * dirichlet (beta, L)
+                       - 0.25 * std::polar (1.0, gamma / 2) * dirichlet (beta + gamma, L)
+                       - 0.25 * std::polar (1.0, -gamma / 2) * dirichlet (beta - gamma, L);
+            };
+
+            for (int k = first; k <= last; k++)
+            {
+                // Transforms of w at bins k and -k, with w starting at sample W - L (the padding follows)
+                const double binStep = twoPi * k / N;
+                const double shift = twoPi * double ((int64) k * (N - W + L) % N) / N;
+
+                const Complex z = gain * std::polar (1.0, shift) * hannSum (-binStep - theta);
+                const Complex zMirror = gain * std::polar (1.0, -shift) * hannSum (binStep - theta);
+
+                // Transforms of the real and imaginary parts of w
+                const Complex real = (z + std::conj (zMirror)) / 2.0;
+                const Complex imag = (z - std::conj (zMirror)) / Complex (0, 2);
+
+                // Real input: sum x[n] u[n] = sum over k <= N / 2 of c_k / N Re (X[k] conj (U[k]))
+                const double scale = (k == 0 || 2 * k == N ? 1.0 : 2.0) / N;
+
+                bank->binWeights.push_back (SpectrumSample (scale * real.real()));
+                bank->binWeights.push_back (SpectrumSample (scale * real.imag()));
+                bank->binWeights.push_back (SpectrumSample (scale * imag.real()));
+                bank->binWeights.push_back (SpectrumSample (scale * imag.imag()));
+            }
+        }
+        else
         {
-            // Shifted by one half cycle (pi/2)
-            hann[position] = square (std::sin (double_Pi * position / nSampWindow + (double_Pi / 2.0)));
+            bank->numTaps[freq] = L;
+            bank->tapOffset[freq] = (int) bank->taps.size() / 2;
+            bank->maxTaps = jmax (bank->maxTaps, L);
+
+            for (int j = 0; j < L; j++)
+            {
+                const double hann = 0.5 - 0.5 * std::cos (gamma * (j + 0.5));
+
+                bank->taps.push_back (SpectrumSample (gain * hann * std::cos (theta * j)));
+                bank->taps.push_back (SpectrumSample (-gain * hann * std::sin (theta * j)));
+            }
         }
-        // Pad with zeroes
-        else if (position <= (nfft - nSampWindow / 2))
+    }
+
+    LOGD ("Generated ", nFreqs, " wavelets with ", bank->binWeights.size() / 4, " kernel bins and ", bank->taps.size() / 2, " taps");
+
+    return bank;
+}
+
+void CumulativeTFR::applyWavelets (int channelIndex)
+{
+    const WaveletBank& bank = *wavelets;
+
+    const SpectrumSample* spectrum = getInputRow (channelIndex);
+    const SpectrumSample* tail = waveletTails + (size_t) channelIndex * bank.maxTaps;
+    SpectrumSample* coefs = coefficients + (size_t) channelIndex * 2 * nFreqs;
+
+    for (int freq = 0; freq < nFreqs; freq++)
+    {
+        SpectrumSample re = 0;
+        SpectrumSample im = 0;
+
+        if (bank.numBins[freq] > 0)
         {
-            hann[position] = 0;
+            const SpectrumSample* x = spectrum + 2 * bank.firstBin[freq];
+            const SpectrumSample* w = bank.binWeights.data() + 4 * (size_t) bank.binOffset[freq];
+
+            for (int bin = 0; bin < bank.numBins[freq]; bin++)
+            {
+                re += x[2 * bin] * w[4 * bin] + x[2 * bin + 1] * w[4 * bin + 1];
+                im += x[2 * bin] * w[4 * bin + 2] + x[2 * bin + 1] * w[4 * bin + 3];
+            }
         }
-        // Finish off hann function
         else
         {
-            // Move start of wave to nfft - windowSize/2
-            int hannPosition = position - (nfft - nSampWindow / 2);
-            hann[position] = square (std::sin (hannPosition * double_Pi / nSampWindow));
+            const SpectrumSample* x = tail + bank.maxTaps - bank.numTaps[freq];
+            const SpectrumSample* w = bank.taps.data() + 2 * (size_t) bank.tapOffset[freq];
+
+            for (int tap = 0; tap < bank.numTaps[freq]; tap++)
+            {
+                re += x[tap] * w[2 * tap];
+                im += x[tap] * w[2 * tap + 1];
+            }
         }
 
-        //std::cout << position << ": "  << hann[position] << std::endl;
+        coefs[2 * freq] = re;
+        coefs[2 * freq + 1] = im;
     }
+}
 
-    // Wavelet
-    float freqNormalized = freqStart;
+std::shared_ptr<const std::vector<SpectrumSample>> CumulativeTFR::getTapers (int windowSize)
+{
+    // a few window lengths are kept so that switching back to a recent range does not regenerate them
+    const size_t maxUnusedTapers = 4;
 
-    FFTWArrayType fftWaveletBuffer (nfft);
+    static CriticalSection cacheLock;
+    static std::map<int, std::shared_ptr<const vector<SpectrumSample>>> cache;
 
-    //std::cout << "Sine wave at 0 " << std::endl;
+    const ScopedLock lock (cacheLock);
 
-    //std::cout << "Wavelet array: " << std::endl;
-    for (int freq = 0; freq < nFreqs; freq++)
+    auto cached = cache.find (windowSize);
+
+    if (cached != cache.end())
+        return cached->second;
+
+    if (cache.size() >= maxUnusedTapers)
     {
-        for (int position = 0; position < nfft; position++)
+        for (auto it = cache.begin(); it != cache.end();)
+            it = it->second.use_count() == 1 ? cache.erase (it) : std::next (it);
+    }
+
+    auto generated = generateTapers (windowSize);
+    cache[windowSize] = generated;
+
+    return generated;
+}
+
+std::shared_ptr<const std::vector<SpectrumSample>> CumulativeTFR::generateTapers (int windowSize)
+{
+    const int N = jmax (1, windowSize);
+    const double W = MULTITAPER_NW / N;
+
+    // The tapers are the eigenvectors of the largest eigenvalues of a symmetric tridiagonal
+    // matrix that commutes with the time and band limiting operator (Slepian, 1978)
+    vector<double> diag (N), offDiag (N, 0.0); // offDiag[n] couples n - 1 and n
+
+    for (int n = 0; n < N; n++)
+    {
+        diag[n] = std::pow ((N - 1 - 2.0 * n) / 2, 2) * std::cos (2 * double_Pi * W);
+
+        if (n > 0)
+            offDiag[n] = n * (N - n) / 2.0;
+    }
+
+    // number of eigenvalues below x (Sturm sequence)
+    auto countBelow = [&] (double x)
+    {
+        int count = 0;
+        double q = 1;
+
+        for (int n = 0; n < N; n++)
         {
-            // Make sin and cos wave.
-            sinWave[position] = std::sin (position * freqNormalized * (2 * double_Pi) / Fs);
-            cosWave[position] = std::cos (position * freqNormalized * (2 * double_Pi) / Fs);
+            const double coupling = n > 0 ? offDiag[n] * offDiag[n] / q : 0;
+
+            q = diag[n] - x - coupling;
 
-            //if (freq == 0)
-            //{
-            //	std::cout << position << ": " << sinWave[position] << std::endl;
-            //}
+            if (q == 0)
+                q = -std::numeric_limits<double>::min();
+
+            if (q < 0)
+                count++;
         }
-        freqNormalized += freqStep;
 
-        //// Wavelet ////
-        // Put into fft input array
-        for (int position = 0; position < nfft; position++)
+        return count;
+    };
+
+    double lower = 0, upper = 0;
+
+    for (int n = 0; n < N; n++)
+    {
+        const double radius = offDiag[n] + (n + 1 < N ? offDiag[n + 1] : 0);
+        lower = jmin (lower, diag[n] - radius);
+        upper = jmax (upper, diag[n] + radius);
+    }
+
+    // Hamming window energy, matched by the mean power of the tapers
+    double hammingEnergy = 0;
+
+    for (int n = 0; n < N; n++)
+        hammingEnergy += std::pow (0.54 - 0.46 * std::cos (2 * double_Pi * n / N), 2);
+
+    auto generated = std::make_shared<vector<SpectrumSample>> ((size_t) NUM_TAPERS * N);
+    vector<vector<double>> found;
+
+    // elimination with partial pivoting of the shifted matrix: pivots, two superdiagonals, multipliers
+    vector<double> u0 (N), u1 (N), u2 (N), mult (N);
+    vector<bool> swapped (N);
+
+    for (int k = 0; k < jmin (NUM_TAPERS, N); k++)
+    {
+        // bisect for the k-th largest eigenvalue
+        const int rank = N - 1 - k;
+        double lo = lower, hi = upper;
+
+        for (int iteration = 0; iteration < 200 && hi - lo > 1e-13 * jmax (1.0, std::abs (hi)); iteration++)
         {
-            fftWaveletBuffer.set (position, std::complex<double> (cosWave.at (position) * hann.at (position), sinWave.at (position) * hann.at (position)));
+            const double mid = 0.5 * (lo + hi);
+
+            if (countBelow (mid) > rank)
+                hi = mid;
+            else
+                lo = mid;
         }
 
-        fftWaveletBuffer.fftComplex();
+        const double lambda = 0.5 * (lo + hi);
+
+        for (int n = 0; n < N; n++)
+        {
+            u0[n] = diag[n] - lambda;
+            u1[n] = n + 1 < N ? offDiag[n + 1] : 0;
+            u2[n] = 0;
+        }
 
-        // Save fft output for use later
-        for (int i = 0; i < nfft; i++)
+        for (int n = 0; n + 1 < N; n++)
         {
-            waveletArray[freq][i] = fftWaveletBuffer.getAsComplex (i);
+            const double below = offDiag[n + 1];
+
+            if (std::abs (u0[n]) >= std::abs (below))
+            {
+                if (u0[n] == 0)
+                    u0[n] = std::numeric_limits<double>::min();
+
+                mult[n] = below / u0[n];
+                u0[n + 1] -= mult[n] * u1[n];
+                swapped[n] = false;
+            }
+            else
+            {
+                const double rowU1 = u1[n];
+
+                mult[n] = u0[n] / below;
+                u0[n] = below;
+                u1[n] = u0[n + 1];
+                u2[n] = u1[n + 1];
+                u0[n + 1] = rowU1 - mult[n] * u1[n];
+                u1[n + 1] = -mult[n] * u2[n];
+                swapped[n] = true;
+            }
         }
 
-        //std::cout << freq << ": " << waveletArray[freq][0] << std::endl;
+        if (u0[N - 1] == 0)
+            u0[N - 1] = std::numeric_limits<double>::min();
+
+        // inverse iteration from a start that is neither symmetric nor antisymmetric
+        vector<double> v (N);
+
+        for (int n = 0; n < N; n++)
+            v[n] = 1.0 + double (n) / N;
+
+        for (int iteration = 0; iteration < 3; iteration++)
+        {
+            for (int n = 0; n + 1 < N; n++)
+            {
+                if (swapped[n])
+                    std::swap (v[n], v[n + 1]);
+
+                v[n + 1] -= mult[n] * v[n];
+            }
+
+            for (int n = N - 1; n >= 0; n--)
+            {
+                double x = v[n];
+
+                if (n + 1 < N)
+                    x -= u1[n] * v[n + 1];
+
+                if (n + 2 < N)
+                    x -= u2[n] * v[n + 2];
+
+                v[n] = x / u0[n];
+            }
+
+            // keep clear of the tapers already found, in case eigenvalues are close
+            for (const auto& previous : found)
+            {
+                double dot = 0;
+
+                for (int n = 0; n < N; n++)
+                    dot += v[n] * previous[n];
+
+                for (int n = 0; n < N; n++)
+                    v[n] -= dot * previous[n];
+            }
+
+            double norm = 0;
+
+            for (int n = 0; n < N; n++)
+                norm += v[n] * v[n];
+
+            norm = std::sqrt (norm);
+
+            for (int n = 0; n < N; n++)
+                v[n] /= norm;
+        }
+
+        // usual sign convention: symmetric tapers sum to a positive value, antisymmetric ones start positive
+        double polarity = 0;
+
+        for (int n = 0; n < N; n++)
+            polarity += (k % 2 == 0 ? 1.0 : N - 1 - 2.0 * n) * v[n];
+
+        const double scale = (polarity < 0 ? -1 : 1) * std::sqrt (hammingEnergy / NUM_TAPERS);
+
+        for (int n = 0; n < N; n++)
+            (*generated)[(size_t) k * N + n] = SpectrumSample (scale * v[n]);
+
+        found.push_back (std::move (v));
     }
+
+    return generated;
+}
+
+void CumulativeTFR::applyTapers (int channelIndex)
+{
+    SpectrumSample* input = getInputRow (channelIndex);
+    const SpectrumSample* taper = tapers->data();
+
+    for (int k = NUM_TAPERS - 1; k > 0; k--)
+        FloatVectorOperations::multiply (input + (size_t) k * rowStride, input, taper + (size_t) k * windowSize, windowSize);
+
+    FloatVectorOperations::multiply (input, taper, windowSize);
+}
+
+void CumulativeTFR::taperedPower (int channelIndex, SpectrumSample* power) const
+{
+    const SpectrumSample* spectrum = fftData + (size_t) channelIndex * rowsPerChannel * rowStride + 2 * firstBin;
+
+    // the tapers are scaled so that the sum of their powers is the mean
+    SpectralKernels::complexPower (spectrum, power, nFreqs);
+
+    for (int k = 1; k < NUM_TAPERS; k++)
+    {
+        const SpectrumSample* row = spectrum + (size_t) k * rowStride;
+
+        for (int freq = 0; freq < nFreqs; freq++)
+            power[freq] += row[2 * freq] * row[2 * freq] + row[2 * freq + 1] * row[2 * freq + 1];
+    }
+}
+
+const SpectrumSample* CumulativeTFR::getSpectrum (int channelIndex) const
+{
+    if (wavelets != nullptr || method == SLIDING_DFT)
+        return coefficients + (size_t) channelIndex * 2 * nFreqs;
+
+    return fftData + (size_t) channelIndex * rowsPerChannel * rowStride + 2 * firstBin;
 }
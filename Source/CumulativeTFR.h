@@ -25,131 +25,302 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define CUMULATIVE_TFR_H_INCLUDED
 
 #include <OpenEphysFFTW.h>
+#include <fftw3.h>
 
 #include "AtomicSynchronizer.h"
+#include "FFTWPlanner.h"
 
 #include <complex>
+#include <map>
+#include <tuple>
 #include <vector>
 
-using FFTWArrayType = FFTWTransformableArrayUsing<0U>;
-// Changed to FFTW_MEASURE, slow start. Better performance?
-
 class CumulativeTFR
 {
     // shorten some things
     template <typename T>
     using vector = std::vector<T>;
 
-    using RealAccum = StatisticsAccumulator<double>;
+public:
+    // Most channels transformed together by one call to computeFFT, so that a batch's rows stay in cache
+    static const int MAX_CHANNELS_PER_BATCH = 8;
 
-    struct ComplexWeightedAccum
+    // How the power of each frequency is estimated from a window
+    enum Method
     {
-        ComplexWeightedAccum (double alpha)
-            : count (0), sum (0, 0), alpha (alpha)
-        {
-        }
-
-        std::complex<double> getAverage()
-        {
-            return count > 0 ? sum / (double) count : std::complex<double>();
-        }
-
-        void addValue (std::complex<double> x)
-        {
-            sum = x + (1 - alpha) * sum; // Maybe worried about intitial value skewing results..? Could be why its so high always.
-            count = 1 + (1 - alpha) * count;
-        }
-
-        void reset()
-        {
-            count = 0;
-            sum = (0, 0);
-        }
-
-    private:
-        std::complex<double> sum;
-        size_t count;
-
-        const double alpha;
+        PERIODOGRAM = 0, // power of the FFT bins of the Hamming-windowed input, zero-padded to fftLen
+        WAVELET = 1, // power of Hann-tapered complex wavelets ending at the last sample of the unwindowed input
+        SLIDING_DFT = 2, // PERIODOGRAM for selected bins only, updated sample by sample with a sliding DFT
+        MULTITAPER = 3, // mean power of the FFTs of NUM_TAPERS Slepian-tapered copies of the unwindowed input
+        WELCH = 4, // mean power of the Hamming-windowed, half-overlapping segments of the window, each transformed once
+        CONSTANT_Q = 5 // WAVELET at log-spaced frequencies, each wavelet as long as the inverse of its bandwidth
     };
 
-    struct RealWeightedAccum
+    // Log-spaced frequencies of the CONSTANT_Q method per octave
+    static const int CONSTANT_Q_BINS_PER_OCTAVE = 12;
+
+    // Welch segments are this many times shorter than the window
+    static const int WELCH_SEGMENTS_PER_WINDOW = 4;
+
+    // Time-bandwidth product of the Slepian tapers; their spectral resolution is +/- MULTITAPER_NW bins
+    static constexpr double MULTITAPER_NW = 3.0;
+
+    // Number of Slepian tapers averaged by the multitaper method (2 NW - 1, all well concentrated)
+    static const int NUM_TAPERS = 5;
+
+    CumulativeTFR (int nchans, int nf, int nt, double Fs, int fftLen, int windowSize, float winLen = 2, float stepLen = 0.1, float freqStep = 0.25, float freqStart = 1, double alpha = 0, const vector<std::pair<int, int>>& pairs = {}, double coherenceAlpha = 0.02, Method method = PERIODOGRAM, const vector<int>& slidingBins = {}, const vector<float>& constantQFreqs = {}, int numWorkers = 1);
+
+    // Returns the CONSTANT_Q frequencies from lowest up to highest, CONSTANT_Q_BINS_PER_OCTAVE per octave
+    static vector<float> getConstantQFrequencies (float lowest, float highest);
+
+    ~CumulativeTFR();
+
+    // Returns the input row of a channel; fill its first windowSize values before calling computeFFT,
+    // which zero-pads them to fftLen.
+    SpectrumSample* getInputRow (int channelIndex) { return fftData + (size_t) channelIndex * rowsPerChannel * rowStride; }
+
+    // Returns the number of channels in each batch but the last.
+    int getChannelsPerBatch() const { return channelsPerBatch; }
+
+    // Returns the number of batches needed to cover all channels.
+    int getNumBatches() const { return (nChans + channelsPerBatch - 1) / channelsPerBatch; }
+
+    // Transform the rows of one batch of channels in place and update their power.
+    void computeFFT (int batchIndex);
+
+    // Returns how many new samples slideWindow should be given to move a channel's window to windowEnd,
+    // or 0 if its sliding DFT must restart from the whole window.
+    int getSlideLength (int channelIndex, int64 windowEnd) const;
+
+    // Moves the sliding DFT window of a channel to end at windowEnd, and updates its power.
+    // outgoing holds the samples that leave the window, or is nullptr to restart from a whole window in incoming.
+    // The input row of the channel may be used to hold incoming and outgoing, which are not windowed.
+    void slideWindow (int channelIndex, int64 windowEnd, const SpectrumSample* incoming, const SpectrumSample* outgoing, int numSamples);
+
+    // Makes a channel's sliding DFT restart from the whole window on the next step.
+    void resetSlidingDFT (int channelIndex) { slidingEnd[channelIndex] = -1; }
+
+    // Returns the length of each Welch segment, in samples.
+    int getSegmentLength() const { return segmentLen; }
+
+    // Returns the first sample of the next Welch segment of the window ending at windowEnd that a channel
+    // has not transformed yet, or -1 if all of them have been. Segments start at multiples of half their length.
+    int64 getNextSegment (int channelIndex, int64 windowEnd) const;
+
+    // Transforms the Welch segment starting at segmentStart, whose samples fill the channel's input row.
+    void addSegment (int channelIndex, int64 segmentStart);
+
+    // Discards the Welch segments of a channel, so the next window transforms all of its segments.
+    void resetWelch (int channelIndex) { lastSegment[channelIndex] = -1; }
+
+    // Updates the power of a batch of channels from the Welch segments of the window ending at windowEnd;
+    // channels with missing segments are skipped.
+    void computeWelch (int batchIndex, int64 windowEnd);
+
+    // Returns the number of channel pairs with cross-spectra.
+    int getNumPairs() const { return nPairs; }
+
+    // Update the cross-spectrum of a channel pair; call once computeFFT has finished for every batch.
+    void computeCrossSpectrum (int pairIndex);
+
+    // Writes the magnitude-squared coherence of each frequency for a channel pair.
+    void getCoherence (float* coherence, int pairIndex);
+
+    // Writes the power of each frequency for an input channel.
+    void getPower (float* power, int channelIndex);
+
+private:
+    // Number of cycles of every wavelet, unless limited by the window length
+    static const int WAVELET_CYCLES = 7;
+
+    // Half-width of a wavelet's spectral kernel, in units of fftLen / wavelet length bins
+    // (the main lobe of the Hann taper is 2 units wide; the sidelobes beyond 4 are below -48 dB)
+    static const int WAVELET_SUPPORT = 4;
+
+    // Complex wavelets for every frequency, shared by all TFRs with the same sample rate,
+    // window and frequency grid. Each wavelet is applied either as a sparse kernel on the
+    // spectrum of the window or, when that is cheaper, as taps on the last samples of the window.
+    struct WaveletBank
     {
-        RealWeightedAccum (double alpha)
-            : count (0), sum (0), alpha (alpha)
-        {
-        }
-
-        double getAverage()
-        {
-            return count > 0 ? sum / (double) count : double();
-        }
-
-        void addValue (double x)
-        {
-            sum = x + (1 - alpha) * sum;
-            count = 1 + (1 - alpha) * count;
-        }
-
-        void reset()
-        {
-            count = 0;
-            sum = 0;
-        }
-
-    private:
-        double sum;
-        size_t count;
-
-        const double alpha;
+        // Spectral kernels: 4 weights per bin (yr += xr w0 + xi w1, yi += xr w2 + xi w3), from firstBin
+        vector<int> firstBin;
+        vector<int> numBins;
+        vector<int> binOffset;
+        vector<SpectrumSample> binWeights;
+
+        // Time-domain taps: interleaved complex values applied to the last numTaps samples
+        vector<int> numTaps;
+        vector<int> tapOffset;
+        vector<SpectrumSample> taps;
+
+        int maxTaps = 0;
     };
 
-public:
-    CumulativeTFR (int nchans, int nf, int nt, int Fs, float winLen = 2, float stepLen = 0.1, float freqStep = 0.25, int freqStart = 1, double fftSec = 10.0, double alpha = 0);
+    // Returns the cached wavelet bank for a sample rate, window, transform length, frequencies and number of cycles, generating it if needed
+    static std::shared_ptr<const WaveletBank> getWaveletBank (double Fs, int fftLen, int windowSize, const vector<float>& frequencies, double cycles);
 
-    // Handle a new buffer of data. Perform FFT and create pxxs, pyys.
-    void computeFFT (FFTWArrayType& fftBuffer, int channelIndex);
+    // Generate the wavelets to be multiplied by the spectrum of a window of windowSize samples zero-padded to fftLen
+    static std::shared_ptr<const WaveletBank> generateWavelet (double Fs, int fftLen, int windowSize, const vector<float>& frequencies, double cycles);
 
-    // Function to get coherence between two channels
-    void getMeanCoherence (int chanX, int chanY, AtomicallyShared<std::vector<double>>& coherence, int comb);
+    // Writes the wavelet coefficients of a transformed input row, one complex value per frequency
+    void applyWavelets (int channelIndex);
 
-    // Calculates power for input channels based on powerbuffer size.
-    void getPower (std::vector<float>& power, int channelIndex);
+    // Returns the cached Slepian tapers for a window length, generating them if needed
+    static std::shared_ptr<const vector<SpectrumSample>> getTapers (int windowSize);
 
-private:
-    // Generate wavelet to be multplied by the channel spectrum
-    void generateWavelet();
+    // Computes the first NUM_TAPERS discrete prolate spheroidal sequences of length windowSize, one after the other,
+    // each scaled so that their mean power matches that of the Hamming-windowed periodogram for white noise
+    static std::shared_ptr<const vector<SpectrumSample>> generateTapers (int windowSize);
+
+    // Fills the taper rows of a channel with tapered copies of its input row (tapering the input row last)
+    void applyTapers (int channelIndex);
+
+    // Writes the mean power of the transformed taper rows of a channel
+    void taperedPower (int channelIndex, SpectrumSample* power) const;
+
+    // Returns the complex value of each frequency for a channel: its FFT bins, or its wavelet or sliding DFT coefficients
+    const SpectrumSample* getSpectrum (int channelIndex) const;
+
+    // Updates the power sums of a channel from the power of its latest frame
+    void accumulatePower (int channelIndex, const SpectrumSample* power);
+
+    // Returns true if a channel has transformed every Welch segment of the window ending at welchEnd
+    bool hasWelchWindow (int channelIndex) const;
+
+    // Returns the cached spectrum of a channel's Welch segment, segmentBins complex values
+    SpectrumSample* getSegmentSpectrum (int channelIndex, int64 segment) const { return segmentSpectra + ((size_t) channelIndex * segmentCapacity + (size_t) (segment % segmentCapacity)) * 2 * segmentBins; }
+
+    // Updates the cross-spectrum of a channel pair from the Welch segments of its latest window
+    void computeWelchCrossSpectrum (int pairIndex);
+
+    // Returns the first and last Welch segments that fit in the window ending at windowEnd
+    void getWindowSegments (int64 windowEnd, int64& first, int64& last) const;
+
+    // Interpolates values on the segment frequency grid at a displayed frequency
+    SpectrumSample interpolateSegmentBins (const SpectrumSample* segmentValues, int freq) const
+    {
+        const int bin = segmentBinBelow[freq];
+        const SpectrumSample fraction = segmentBinFraction[freq];
 
+        return fraction > 0 ? segmentValues[bin] + fraction * (segmentValues[bin + 1] - segmentValues[bin]) : segmentValues[bin];
+    }
+
+    // Plan an in-place transform of numChannels consecutive rows of fftData
+    std::shared_ptr<FFTWPlanner::BatchPlan> createBatchPlan (int numChannels, SpectrumSample* firstRow);
+
+    const int nChans;
+    const int channelsPerBatch; // enough batches for every worker, up to MAX_CHANNELS_PER_BATCH channels each
     const int nFreqs;
-    const int Fs;
+    const double Fs; // sample rate after decimation, not necessarily whole
+    const int fftLen;
+    const int windowSize; // samples in each window, followed by fftLen - windowSize zeros
     const int nTimes;
-    const int nfft;
     int segmentLen;
     float windowLen;
     float stepLen;
 
     float freqStep;
-    int freqStart;
-    int freqEnd;
+    float freqStart;
+
+    // FFT bin of the first displayed frequency (freqStart / freqStep)
+    int firstBin;
+
+    const Method method;
+
+    std::shared_ptr<const WaveletBank> wavelets;
+
+    // Multitaper: NUM_TAPERS tapers of windowSize samples each
+    std::shared_ptr<const vector<SpectrumSample>> tapers;
+
+    // Sliding DFT: displayed bins, and the FFT bins tracked to window them (each displayed bin and its neighbours).
+    // A displayed bin at FFT bin k is 0.54 X[k] - 0.23 (X[k - 1] + X[k + 1]), the Hamming-windowed periodogram.
+    vector<int> slidingBins;
+    vector<int> trackedBins;
+    vector<int> trackedIndex; // position of each displayed bin in trackedBins
+    vector<double> trackedCos;
+    vector<double> trackedSin;
 
-    int trimTime;
+    // Sample count at the end of each channel's sliding window, or -1 before the first window
+    vector<int64> slidingEnd;
 
-    bool printout;
+    // Welch: Hamming window of a segment, scaled so that white noise has the same power as the full window,
+    // the segment bin below each displayed frequency and the weight of the bin above it
+    vector<SpectrumSample> segmentWindow;
+    vector<int> segmentBinBelow;
+    vector<SpectrumSample> segmentBinFraction;
 
-    // # channels x # frequencies x # times
-    vector<vector<vector<std::complex<double>>>> spectrumBuffer;
+    int segmentHop = 0;
+    int segmentBins = 0; // segment bins up to the highest displayed frequency
+    int segmentCapacity = 0; // segments kept per channel, at least as many as fit in a window
 
-    // dimensions?
-    vector<vector<std::complex<double>>> waveletArray;
+    // Index of each channel's latest transformed segment (its start / segmentHop), or -1 if none
+    vector<int64> lastSegment;
 
-    FFTWArrayType ifftBuffer;
+    // End of the window each channel's Welch power was last computed for
+    vector<int64> welchEnd;
+
+    std::shared_ptr<FFTWPlanner::BatchPlan> segmentPlan;
+
+    // Channel x sample matrix transformed in place, one row per channel and taper
+    SpectrumSample* fftData = nullptr;
+
+    // Rows of fftData per channel: NUM_TAPERS in MULTITAPER mode, otherwise 1
+    int rowsPerChannel;
+
+    // Distance between rows of fftData, in samples
+    int rowStride;
+
+    // Plans for a full batch of channels and for the last, partial batch
+    // (estimates at first, replaced by measured plans once the planner has made them)
+    std::shared_ptr<FFTWPlanner::BatchPlan> batchPlan;
+    std::shared_ptr<FFTWPlanner::BatchPlan> lastBatchPlan;
 
     // For exponential average
     double alpha;
-    // Store cross-spectra : # channel combinations x # frequencies x # times
-    vector<vector<vector<ComplexWeightedAccum>>> pxys;
-    // Store power : # channels x # frequencies x # times
-    vector<vector<vector<RealWeightedAccum>>> powBuffer;
+
+    // Exponential average of the cross-spectra, and of the powers they are normalized by
+    double coherenceAlpha;
+
+    // Channel pairs with cross-spectra, as indices of input channels
+    const vector<std::pair<int, int>> pairs;
+    const int nPairs;
+
+    // Each average is sum / weight, with sum <- x + (1 - alpha) * sum and weight <- 1 + (1 - alpha) * weight.
+    // All sums and weights live in one 64-byte aligned allocation, frequencies innermost:
+    //   power sums:            # channels x # times x # frequencies
+    //   coherence power sums:  # channels x # times x # frequencies (only with pairs, at coherenceAlpha)
+    //   cross-spectra sums:    real, then imaginary parts, # pairs x # times x # frequencies
+    //   power frames:          # batches x # frequencies (scratch for computeFFT)
+    //   wavelet tails:         # channels x maximum taps (only in WAVELET and CONSTANT_Q modes, the input saved before the FFT)
+    //   coefficients:          # channels x # frequencies x 2 (only in WAVELET, CONSTANT_Q and SLIDING_DFT modes)
+    //   sliding DFT state:     real, then imaginary parts, # channels x # tracked bins (only in SLIDING_DFT mode)
+    //   segment spectra:       # channels x segment capacity x segment bins x 2 (only in WELCH mode)
+    //   segment sums:          (# batches + 2) x segment bins (only in WELCH mode; scratch for computeWelch and cross-spectra)
+    //   power weights:         # channels x # times
+    //   coherence power weights: # channels x # times
+    //   cross-spectra weights: # pairs x # times
+    void* accumulatorMemory = nullptr;
+
+    SpectrumSample* powSums = nullptr;
+    SpectrumSample* cohPowSums = nullptr;
+    SpectrumSample* pxyRealSums = nullptr;
+    SpectrumSample* pxyImagSums = nullptr;
+    SpectrumSample* powerFrames = nullptr;
+    SpectrumSample* waveletTails = nullptr;
+    SpectrumSample* coefficients = nullptr;
+    double* slidingReal = nullptr;
+    double* slidingImag = nullptr;
+    SpectrumSample* segmentSpectra = nullptr;
+    SpectrumSample* segmentSums = nullptr;
+    double* powWeights = nullptr;
+    double* cohPowWeights = nullptr;
+    double* pxyWeights = nullptr;
+
+    // Adds one frame of nFreqs values to a row of sums; the caller updates the row's weight
+    void accumulate (SpectrumSample* sums, const SpectrumSample* frame, double alpha) const;
+
+    // Returns the sums of a channel or channel pair at a time index
+    SpectrumSample* getSums (SpectrumSample* block, int row, int t) const { return block + ((size_t) row * nTimes + t) * nFreqs; }
 
     // calculate a single magnitude-squared coherence from cross spectrum and auto-power values
     static double singleCoherence (double pxx, double pyy, std::complex<double> pxy);
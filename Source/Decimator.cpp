@@ -0,0 +1,213 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "Decimator.h"
+
+#include <cmath>
+
+namespace
+{
+/** Zeroth-order modified Bessel function of the first kind */
+double besselI0 (double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+
+    for (int k = 1; k < 50; k++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+
+        if (term < sum * 1e-12)
+            break;
+    }
+
+    return sum;
+}
+} // namespace
+
+int Decimator::getFactorFor (float sampleRate, float passbandEdge)
+{
+    if (passbandEdge <= 0)
+        return 1;
+
+    // the stopband starts at the output rate minus passbandEdge
+    return getFactorForRate (sampleRate, jmax (2.5 * passbandEdge, 2.0 * passbandEdge + MIN_TRANSITION * sampleRate));
+}
+
+int Decimator::getFactorForRate (float sampleRate, double minOutputRate)
+{
+    if (minOutputRate <= 0)
+        return 1;
+
+    int factor = jmax (1, int (sampleRate / minOutputRate));
+
+    // keep the decimated rate a whole number of Hz when the input rate is one
+    const int rate = roundToInt (sampleRate);
+
+    if (rate == sampleRate)
+        while (rate % factor != 0)
+            factor--;
+
+    return factor;
+}
+
+void Decimator::prepare (int numChannels_, int factor_, float sampleRate, float passbandEdge, float stopbandEdge)
+{
+    numChannels = numChannels_;
+    factor = jmax (1, factor_);
+
+    if (factor == 1)
+    {
+        numTaps = 1;
+        historySize = 0;
+        taps.free();
+        history.free();
+        skip = 0;
+        return;
+    }
+
+    // pass up to passbandEdge, stop from the first frequency that aliases onto it (unless told otherwise)
+    const double outputRate = sampleRate / factor;
+    const double stopband = stopbandEdge > 0 ? stopbandEdge : outputRate - passbandEdge;
+    const double transition = (stopband - passbandEdge) / sampleRate;
+    const double cutoff = (passbandEdge + stopband) / 2;
+
+    // Kaiser window for 80 dB of attenuation
+    const double attenuation = 80.0;
+    const double beta = 0.1102 * (attenuation - 8.7);
+
+    // getFactorFor() leaves room for this, up to rounding; a narrower band would need a longer filter
+    jassert (transition >= 0.99 * MIN_TRANSITION);
+
+    numTaps = int (std::ceil ((attenuation - 8) / (2.285 * 2 * double_Pi * transition))) + 1;
+    numTaps |= 1; // odd length, so the delay is a whole number of samples
+
+    taps.allocate (numTaps, false);
+
+    const double centre = (numTaps - 1) / 2.0;
+    double sum = 0;
+
+    for (int n = 0; n < numTaps; n++)
+    {
+        // sinc with its cutoff in the middle of the transition band
+        const double x = 2 * cutoff * (n - centre) / sampleRate;
+        const double sinc = x == 0 ? 1.0 : std::sin (double_Pi * x) / (double_Pi * x);
+
+        const double r = (n - centre) / centre;
+        const double kaiser = besselI0 (beta * std::sqrt (jmax (0.0, 1 - r * r))) / besselI0 (beta);
+
+        taps[n] = float (sinc * kaiser);
+        sum += taps[n];
+    }
+
+    // unity gain at DC
+    for (int n = 0; n < numTaps; n++)
+        taps[n] = float (taps[n] / sum);
+
+    historySize = numTaps - 1 + CHUNK_SIZE;
+    history.allocate ((size_t) numChannels * historySize, true);
+
+    skip = 0;
+
+    LOGD ("Decimating by ", factor, " with ", numTaps, " taps for ", numChannels, " channels");
+}
+
+void Decimator::reset()
+{
+    if (history != nullptr)
+        history.clear ((size_t) numChannels * historySize);
+
+    skip = 0;
+}
+
+int Decimator::getNumOutputs (int numSamples) const
+{
+    return skip < numSamples ? (numSamples - 1 - skip) / factor + 1 : 0;
+}
+
+int Decimator::process (int channel, const float* input, int numSamples, float* dest)
+{
+    if (factor == 1)
+    {
+        FloatVectorOperations::copy (dest, input, numSamples);
+        return numSamples;
+    }
+
+    float* buffer = history + (size_t) channel * historySize;
+    const int numPrevious = numTaps - 1;
+
+    int channelSkip = skip;
+    int numWritten = 0;
+
+    for (int start = 0; start < numSamples; start += CHUNK_SIZE)
+    {
+        const int chunk = jmin (CHUNK_SIZE, numSamples - start);
+
+        FloatVectorOperations::copy (buffer + numPrevious, input + start, chunk);
+
+        // the output that ends at new sample i uses buffer[i] to buffer[i + numTaps - 1]
+        int i = channelSkip;
+
+        for (; i < chunk; i += factor)
+        {
+            const float* x = buffer + i;
+
+            // independent partial sums, so the adds do not wait on each other
+            float y0 = 0, y1 = 0, y2 = 0, y3 = 0;
+            int t = 0;
+
+            for (; t + 4 <= numTaps; t += 4)
+            {
+                y0 += x[t] * taps[t];
+                y1 += x[t + 1] * taps[t + 1];
+                y2 += x[t + 2] * taps[t + 2];
+                y3 += x[t + 3] * taps[t + 3];
+            }
+
+            for (; t < numTaps; t++)
+                y0 += x[t] * taps[t];
+
+            dest[numWritten++] = (y0 + y1) + (y2 + y3);
+        }
+
+        channelSkip = i - chunk;
+
+        // keep the last numTaps - 1 samples for the next chunk
+        memmove (buffer, buffer + chunk, (size_t) numPrevious * sizeof (float));
+    }
+
+    return numWritten;
+}
+
+int Decimator::finishBlock (int numSamples)
+{
+    if (factor == 1)
+        return numSamples;
+
+    const int numOutputs = getNumOutputs (numSamples);
+
+    skip = skip + numOutputs * factor - numSamples;
+
+    return numOutputs;
+}
@@ -0,0 +1,113 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DECIMATOR_H_INCLUDED
+#define DECIMATOR_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+/*
+	Low-pass filters and downsamples every channel by the same integer factor.
+
+	The anti-aliasing filter is a linear-phase, Kaiser-windowed sinc (80 dB
+	stopband) that passes everything below the displayed upper frequency
+	and removes everything that would alias onto it. Only the samples that
+	are kept are computed, so the work per input sample is the number of
+	taps divided by the factor.
+
+	Like SpectrumEngine, blocks are written one channel at a time with
+	process() and then completed for all channels with finishBlock().
+*/
+class Decimator
+{
+public:
+    /** Number of input samples filtered at a time; larger blocks are split */
+    static const int CHUNK_SIZE = 1024;
+
+    /** Constructor */
+    Decimator() {}
+
+    /** Destructor */
+    ~Decimator() {}
+
+    /** Narrowest transition band the factors leave, as a fraction of the input rate.
+        It bounds the filter to about 50000 taps. */
+    static constexpr double MIN_TRANSITION = 1e-4;
+
+    /** Returns the largest factor that keeps the output rate at least
+        2.5 times passbandEdge, leaving room for the filter's transition band.
+        The factor is smaller if that band would be narrower than MIN_TRANSITION. */
+    static int getFactorFor (float sampleRate, float passbandEdge);
+
+    /** Returns the largest factor that keeps the output rate at least minOutputRate.
+        For whole-number sample rates, the factor divides the rate evenly. */
+    static int getFactorForRate (float sampleRate, double minOutputRate);
+
+    /** Designs the filter for a factor and clears the history of every channel.
+        The stopband starts at stopbandEdge, or at the first frequency that aliases
+        onto passbandEdge if it is 0, and must leave a transition band of at least
+        MIN_TRANSITION. A factor of 1 passes samples through unchanged. */
+    void prepare (int numChannels, int factor, float sampleRate, float passbandEdge, float stopbandEdge = 0);
+
+    /** Clears the history of every channel */
+    void reset();
+
+    /** Filters and decimates a block of one channel into dest, which must hold
+        numSamples / factor + 1 samples. Returns the number of samples written (audio thread) */
+    int process (int channel, const float* input, int numSamples, float* dest);
+
+    /** Advances the output phase once a block has been processed for all channels,
+        returning the number of samples each channel produced (audio thread) */
+    int finishBlock (int numSamples);
+
+    /** Returns the decimation factor */
+    int getFactor() const { return factor; }
+
+    /** Returns the number of filter taps */
+    int getNumTaps() const { return numTaps; }
+
+    /** Returns the memory used by each channel, in bytes */
+    size_t getBytesPerChannel() const { return (size_t) historySize * sizeof (float); }
+
+private:
+    /** Returns the number of outputs produced by numSamples inputs from the current phase */
+    int getNumOutputs (int numSamples) const;
+
+    /** Filter taps (symmetric, so no reversal is needed) */
+    HeapBlock<float> taps;
+
+    /** numTaps - 1 previous samples followed by room for one chunk, per channel */
+    HeapBlock<float> history;
+
+    int numChannels = 0;
+    int factor = 1;
+    int numTaps = 1;
+    int historySize = 0;
+
+    /** Number of input samples to take before the next output */
+    int skip = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Decimator);
+};
+
+#endif // DECIMATOR_H_INCLUDED
@@ -0,0 +1,119 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "DecimatorCascade.h"
+
+void DecimatorCascade::prepare (int numChannels, float sampleRate, const std::vector<float>& passbandEdges)
+{
+    const int numLevels = (int) passbandEdges.size();
+
+    while (stages.size() > numLevels)
+        stages.removeLast();
+
+    while (stages.size() < numLevels)
+        stages.add (new Decimator());
+
+    outputs.assign (numLevels, nullptr);
+    numOutputs.assign (numLevels, 0);
+    outputRates.assign (numLevels, sampleRate);
+    factors.assign (numLevels, 1);
+
+    float inputRate = sampleRate;
+    int totalFactor = 1;
+
+    for (int level = 0; level < numLevels; level++)
+    {
+        jassert (level == 0 || passbandEdges[level] <= passbandEdges[level - 1]);
+
+        // each stage only removes what the previous level kept above this level's passband
+        const int factor = Decimator::getFactorFor (inputRate, passbandEdges[level]);
+        stages[level]->prepare (numChannels, factor, inputRate, passbandEdges[level]);
+
+        inputRate /= factor;
+        totalFactor *= factor;
+
+        outputRates[level] = inputRate;
+        factors[level] = totalFactor;
+    }
+
+    scratch.allocate ((size_t) jmax (1, numLevels) * (MAX_BLOCK_SIZE + 1), true);
+}
+
+void DecimatorCascade::reset()
+{
+    for (auto* stage : stages)
+        stage->reset();
+}
+
+void DecimatorCascade::process (int channel, const float* input, int numSamples)
+{
+    const float* levelInput = input;
+    int numLevelInputs = numSamples;
+
+    for (int level = 0; level < stages.size(); level++)
+    {
+        if (stages[level]->getFactor() > 1)
+        {
+            float* dest = scratch + (size_t) level * (MAX_BLOCK_SIZE + 1);
+
+            numLevelInputs = stages[level]->process (channel, levelInput, numLevelInputs, dest);
+            levelInput = dest;
+        }
+
+        outputs[level] = levelInput;
+        numOutputs[level] = numLevelInputs;
+    }
+}
+
+void DecimatorCascade::finishBlock (int numSamples)
+{
+    for (int level = 0; level < stages.size(); level++)
+    {
+        numSamples = stages[level]->finishBlock (numSamples);
+        numOutputs[level] = numSamples;
+    }
+}
+
+size_t DecimatorCascade::getBytesPerChannel() const
+{
+    size_t bytes = 0;
+
+    for (auto* stage : stages)
+        bytes += stage->getBytesPerChannel();
+
+    return bytes;
+}
+
+double DecimatorCascade::getTapsPerInputSample() const
+{
+    double taps = 0;
+
+    for (int level = 0; level < stages.size(); level++)
+    {
+        if (stages[level]->getFactor() > 1)
+            taps += double (stages[level]->getNumTaps()) / factors[level];
+    }
+
+    return taps;
+}
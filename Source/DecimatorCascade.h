@@ -0,0 +1,110 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef DECIMATOR_CASCADE_H_INCLUDED
+#define DECIMATOR_CASCADE_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include "Decimator.h"
+
+#include <vector>
+
+/*
+	Produces every channel at several sample rates at once, one level per
+	displayed upper frequency, from a chain of Decimators.
+
+	Level 0 decimates the input, and every further level decimates the
+	output of the level before it, so only the first stage runs at the
+	input rate. Each level divides the rate of the level before it by the
+	largest factor that keeps it at least 2.5 times its passband edge (see
+	Decimator::getFactorFor). Since the factors are chosen one level at a
+	time, a level can end up faster than a single Decimator would make it,
+	but always at least 2.5 times its edge. A level that needs no
+	decimation passes its input through without copying it.
+
+	Like Decimator, blocks are written one channel at a time with process()
+	and then completed for all channels with finishBlock().
+*/
+class DecimatorCascade
+{
+public:
+    /** Longest block process() accepts; longer blocks must be split by the caller */
+    static const int MAX_BLOCK_SIZE = 8192;
+
+    /** Constructor */
+    DecimatorCascade() {}
+
+    /** Destructor */
+    ~DecimatorCascade() {}
+
+    /** Designs one level per passband edge, which must be in decreasing order,
+        and clears the history of every channel */
+    void prepare (int numChannels, float sampleRate, const std::vector<float>& passbandEdges);
+
+    /** Clears the history of every channel */
+    void reset();
+
+    /** Filters and decimates a block of one channel through every level (audio thread) */
+    void process (int channel, const float* input, int numSamples);
+
+    /** Returns the samples of a level for the channel last given to process() (audio thread) */
+    const float* getOutput (int level) const { return outputs[level]; }
+
+    /** Returns the number of samples of a level for the channel last given to process() (audio thread) */
+    int getNumOutputs (int level) const { return numOutputs[level]; }
+
+    /** Advances the output phase of every level once a block has been processed for all channels (audio thread) */
+    void finishBlock (int numSamples);
+
+    /** Returns the number of levels */
+    int getNumLevels() const { return stages.size(); }
+
+    /** Returns the sample rate of a level */
+    float getOutputRate (int level) const { return outputRates[level]; }
+
+    /** Returns the total decimation factor of a level */
+    int getFactor (int level) const { return factors[level]; }
+
+    /** Returns the memory used by each channel, in bytes */
+    size_t getBytesPerChannel() const;
+
+    /** Returns the number of filter multiply-adds per input sample, for every channel */
+    double getTapsPerInputSample() const;
+
+private:
+    OwnedArray<Decimator> stages;
+
+    /** One decimated block per level */
+    HeapBlock<float> scratch;
+
+    std::vector<const float*> outputs;
+    std::vector<int> numOutputs;
+    std::vector<float> outputRates;
+    std::vector<int> factors;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DecimatorCascade);
+};
+
+#endif // DECIMATOR_CASCADE_H_INCLUDED
@@ -0,0 +1,136 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "DisplaySmoother.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+/** Frames per second the low-pass filter is designed for */
+const double FRAME_RATE = 50;
+
+/** Cut-off frequency of the low-pass filter, in Hz */
+const double CUTOFF = 1;
+} // namespace
+
+void DisplaySmoother::prepare (int numChannels_, int numBins_)
+{
+    numChannels = numChannels_;
+    numBins = numBins_;
+
+    // 2nd order Butterworth low-pass, from the bilinear transform with a prewarped cut-off
+    const double k = std::tan (MathConstants<double>::pi * CUTOFF / FRAME_RATE);
+    const double norm = 1.0 / (1.0 + MathConstants<double>::sqrt2 * k + k * k);
+
+    b0 = k * k * norm;
+    b1 = 2.0 * b0;
+    b2 = b0;
+    a1 = 2.0 * (k * k - 1.0) * norm;
+    a2 = (1.0 - MathConstants<double>::sqrt2 * k + k * k) * norm;
+
+    state.allocate ((size_t) numChannels * 2 * numBins, true);
+}
+
+void DisplaySmoother::reset()
+{
+    state.clear ((size_t) numChannels * 2 * numBins);
+}
+
+void DisplaySmoother::filter (int channel, float* frame, int numBins_)
+{
+    jassert (channel >= 0 && channel < numChannels && numBins_ == numBins);
+
+    double* v1 = state + (size_t) channel * 2 * numBins;
+    double* v2 = v1 + numBins;
+
+    const double c0 = b0, c1 = b1, c2 = b2, d1 = a1, d2 = a2;
+
+    if (isFinite (frame, numBins))
+    {
+        // the usual case: every bin is filtered by the same vector instructions
+        for (int n = 0; n < numBins; n++)
+        {
+            const double s1 = v1[n];
+            const double w = frame[n] - d1 * s1 - d2 * v2[n];
+
+            frame[n] = (float) (c0 * w + c1 * s1 + c2 * v2[n]);
+            v2[n] = s1;
+            v1[n] = w;
+        }
+    }
+    else
+    {
+        for (int n = 0; n < numBins; n++)
+        {
+            if (! std::isfinite (frame[n]))
+                continue;
+
+            const double s1 = v1[n];
+            const double w = frame[n] - d1 * s1 - d2 * v2[n];
+
+            frame[n] = (float) (c0 * w + c1 * s1 + c2 * v2[n]);
+            v2[n] = s1;
+            v1[n] = w;
+        }
+    }
+}
+
+bool DisplaySmoother::isFinite (const float* frame, int numBins)
+{
+    // an exponent of all ones marks infinities and NaN; testing the bits instead of
+    // comparing values raises no floating point exceptions, so the loop is vectorized
+    uint32 nonFinite = 0;
+
+    for (int n = 0; n < numBins; n++)
+    {
+        uint32 bits;
+        std::memcpy (&bits, frame + n, sizeof (bits));
+        nonFinite |= (uint32) ((bits & 0x7f800000) == 0x7f800000);
+    }
+
+    return nonFinite == 0;
+}
+
+void DisplaySmoother::boxcar (const float* input, float* dest, int numBins)
+{
+    if (numBins <= 0)
+        return;
+
+    const int last = numBins - 1;
+
+    // the sum around bin 0, with bin 0 repeated beyond the left edge
+    double sum = 0;
+
+    for (int offset = -BOXCAR_RADIUS; offset <= BOXCAR_RADIUS; offset++)
+        sum += input[jlimit (0, last, offset)];
+
+    for (int n = 0; n < numBins; n++)
+    {
+        dest[n] = (float) sum * BOXCAR_WEIGHT;
+
+        // slide the window one bin up
+        sum += input[jmin (n + BOXCAR_RADIUS + 1, last)] - input[jmax (n - BOXCAR_RADIUS, 0)];
+    }
+}
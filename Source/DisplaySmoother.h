@@ -0,0 +1,90 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DISPLAY_SMOOTHER_H_INCLUDED
+#define DISPLAY_SMOOTHER_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+/*
+	Smooths displayed power spectra over time and across frequencies.
+
+	Over time, every bin of every channel goes through the same 2nd order
+	Butterworth low-pass filter (1 Hz cut-off for 50 frames per second),
+	in direct form II with double-precision state. The state is stored
+	bin-major per channel, so a whole frame is filtered in one loop that
+	the compiler vectorizes. Bins that are not finite are passed through
+	and leave their state untouched; frames containing any are filtered
+	one bin at a time.
+
+	Across frequencies, a 9-bin boxcar is applied with a running sum, at a
+	constant cost per bin whatever the width.
+*/
+class DisplaySmoother
+{
+public:
+    /** Constructor */
+    DisplaySmoother() {}
+
+    /** Destructor */
+    ~DisplaySmoother() {}
+
+    /** Allocates and clears the state of every bin of every channel */
+    void prepare (int numChannels, int numBins);
+
+    /** Clears the state of every bin of every channel */
+    void reset();
+
+    /** Low-pass filters one frame of a channel in place */
+    void filter (int channel, float* frame, int numBins);
+
+    /** Writes the average of the bins within BOXCAR_RADIUS of each bin, repeating
+        the first and last bins beyond the edges. dest must not overlap input. */
+    static void boxcar (const float* input, float* dest, int numBins);
+
+    /** Bins on each side of the boxcar */
+    static const int BOXCAR_RADIUS = 4;
+
+    /** Weight of each boxcar bin (1/9, rounded as the display has always used it) */
+    static constexpr float BOXCAR_WEIGHT = 0.1111f;
+
+    /** Returns the number of channels */
+    int getNumChannels() const { return numChannels; }
+
+private:
+    /** Returns true if no value is infinite or NaN */
+    static bool isFinite (const float* frame, int numBins);
+
+    /** Biquad coefficients, normalized by a0 */
+    double b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+
+    /** Delayed values of each bin of each channel: numBins v1 followed by numBins v2 per channel */
+    HeapBlock<double> state;
+
+    int numChannels = 0;
+    int numBins = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DisplaySmoother);
+};
+
+#endif // DISPLAY_SMOOTHER_H_INCLUDED
@@ -0,0 +1,235 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "FFTWPlanner.h"
+
+FFTWPlanner::BatchPlan::~BatchPlan()
+{
+    // analyses are freed on the message thread, which must not wait for a measurement
+    FFTWPlanner& planner = FFTWPlanner::getInstance();
+
+    Plan current = plan.load();
+
+    if (current != nullptr)
+        planner.destroyPlan (current);
+
+    if (estimatePlan != nullptr && estimatePlan != current)
+        planner.destroyPlan (estimatePlan);
+}
+
+FFTWPlanner& FFTWPlanner::getInstance()
+{
+    static FFTWPlanner instance;
+    return instance;
+}
+
+int FFTWPlanner::getFastLength (int minimumLength)
+{
+    for (int length = jmax (1, minimumLength);; length++)
+    {
+        int remainder = length;
+
+        for (int factor : { 2, 3, 5, 7 })
+        {
+            while (remainder % factor == 0)
+                remainder /= factor;
+        }
+
+        if (remainder == 1)
+            return length;
+    }
+}
+
+FFTWPlanner::FFTWPlanner()
+    : Thread ("FFTW Planner")
+{
+#if SPECTRUM_VIEWER_FFTW_THREADS
+    // plans are made on background threads, while other plugins plan on the message thread
+    SPECTRUM_FFTW (make_planner_thread_safe)();
+#endif
+}
+
+FFTWPlanner::~FFTWPlanner()
+{
+    signalThreadShouldExit();
+    notify();
+    stopThread (5000);
+
+    const ScopedLock lock (plannerLock);
+    destroyRetiredPlans();
+}
+
+void FFTWPlanner::destroyPlan (Plan plan)
+{
+    {
+        const ScopedLock queue (queueLock);
+        retiredPlans.push_back (plan);
+    }
+
+    wakeUp();
+}
+
+void FFTWPlanner::destroyRetiredPlans()
+{
+    std::vector<Plan> plans;
+
+    {
+        const ScopedLock queue (queueLock);
+        plans.swap (retiredPlans);
+    }
+
+    for (Plan plan : plans)
+        SPECTRUM_FFTW (destroy_plan) (plan);
+}
+
+void FFTWPlanner::wakeUp()
+{
+    if (! isThreadRunning())
+        startThread();
+
+    notify();
+}
+
+File FFTWPlanner::getWisdomFile() const
+{
+    return File::getSpecialLocation (File::userApplicationDataDirectory)
+        .getChildFile ("open-ephys")
+#if SPECTRUM_VIEWER_SINGLE_PRECISION
+        .getChildFile ("spectrum-viewer-fftwf-wisdom.txt");
+#else
+        .getChildFile ("spectrum-viewer-fftw-wisdom.txt");
+#endif
+}
+
+void FFTWPlanner::loadWisdom()
+{
+    // called when the plugin loads, so only lock the planner the first time
+    if (wisdomLoaded.load())
+        return;
+
+    const ScopedLock lock (plannerLock);
+
+    if (wisdomLoaded.exchange (true))
+        return;
+
+    File wisdomFile = getWisdomFile();
+
+    if (wisdomFile.existsAsFile())
+    {
+        if (SPECTRUM_FFTW (import_wisdom_from_filename) (wisdomFile.getFullPathName().toRawUTF8()))
+            LOGD ("Loaded FFTW wisdom from ", wisdomFile.getFullPathName());
+        else
+            LOGC ("Could not read FFTW wisdom from ", wisdomFile.getFullPathName());
+    }
+}
+
+FFTWPlanner::Plan FFTWPlanner::createPlan (const BatchPlan& batch, SpectrumSample* firstRow, unsigned flags)
+{
+    int n[] = { batch.fftLen };
+
+    return SPECTRUM_FFTW (plan_many_dft_r2c) (1, n, batch.numTransforms, firstRow, nullptr, 1, batch.rowStride, reinterpret_cast<Complex*> (firstRow), nullptr, 1, batch.rowStride / 2, flags);
+}
+
+std::shared_ptr<FFTWPlanner::BatchPlan> FFTWPlanner::planBatch (int fftLen, int numTransforms, int rowStride, SpectrumSample* firstRow)
+{
+    loadWisdom();
+
+    auto batch = std::make_shared<BatchPlan>();
+    batch->fftLen = fftLen;
+    batch->numTransforms = numTransforms;
+    batch->rowStride = rowStride;
+
+    const ScopedLock lock (plannerLock);
+
+    // planning from wisdom is fast and leaves the arrays untouched
+    Plan plan = createPlan (*batch, firstRow, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+
+    if (plan != nullptr)
+    {
+        batch->plan = plan;
+        return batch;
+    }
+
+    batch->estimatePlan = createPlan (*batch, firstRow, FFTW_ESTIMATE);
+    batch->plan = batch->estimatePlan;
+
+    {
+        const ScopedLock queue (queueLock);
+        pendingPlans.push_back (batch);
+    }
+
+    wakeUp();
+
+    return batch;
+}
+
+void FFTWPlanner::run()
+{
+    while (! threadShouldExit())
+    {
+        {
+            const ScopedLock lock (plannerLock);
+            destroyRetiredPlans();
+        }
+
+        std::shared_ptr<BatchPlan> batch;
+
+        {
+            const ScopedLock queue (queueLock);
+
+            // skip plans whose owner has already been destroyed
+            while (batch == nullptr && ! pendingPlans.empty())
+            {
+                batch = pendingPlans.front().lock();
+                pendingPlans.erase (pendingPlans.begin());
+            }
+        }
+
+        // a notify() that arrived since the queues were emptied is not lost
+        if (batch == nullptr)
+        {
+            wait (-1);
+            continue;
+        }
+
+        // measuring overwrites the arrays, so use scratch memory with the same layout
+        SpectrumSample* scratch = SPECTRUM_FFTW (alloc_real) ((size_t) batch->numTransforms * batch->rowStride);
+
+        const ScopedLock lock (plannerLock);
+
+        Plan measured = createPlan (*batch, scratch, FFTW_MEASURE);
+
+        if (measured != nullptr)
+        {
+            batch->plan.store (measured, std::memory_order_release);
+
+            File wisdomFile = getWisdomFile();
+            wisdomFile.getParentDirectory().createDirectory();
+            SPECTRUM_FFTW (export_wisdom_to_filename) (wisdomFile.getFullPathName().toRawUTF8());
+
+            LOGD ("Measured FFTW plan for ", batch->numTransforms, " transforms of length ", batch->fftLen);
+        }
+
+        SPECTRUM_FFTW (free) (scratch);
+    }
+}
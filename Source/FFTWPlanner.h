@@ -0,0 +1,132 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef FFTW_PLANNER_H_INCLUDED
+#define FFTW_PLANNER_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include <fftw3.h>
+
+#include "SpectrumSample.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/*
+	Creates and destroys every FFTW plan used by the plugin.
+
+	FFTW's planner is not thread-safe, so all planner calls go through one lock.
+	Wisdom is kept in a file under the user config directory and loaded when the
+	plugin loads. If a requested plan is not covered by that wisdom, a cheap
+	FFTW_ESTIMATE plan is returned right away and an FFTW_MEASURE plan is made
+	on a background thread. The measured plan is swapped in once it is ready,
+	and the wisdom file is updated so the next start is fast.
+
+	Measuring holds the lock for as long as it takes, so the message thread never
+	takes it: plans of destroyed analyses are handed to the planner thread, which
+	destroys them between measurements. When FFTW's threads library is available,
+	the planner is also made thread-safe for the rest of the process, since other
+	plugins plan with the same global planner without this lock.
+*/
+class FFTWPlanner : public Thread
+{
+public:
+    using Plan = SPECTRUM_FFTW (plan);
+    using Complex = SPECTRUM_FFTW (complex);
+
+    /** A batch of in-place real-to-complex transforms whose plan can be upgraded in the background */
+    class BatchPlan
+    {
+    public:
+        /** Destructor */
+        ~BatchPlan();
+
+        /** Returns the best plan available so far */
+        Plan get() const { return plan.load (std::memory_order_acquire); }
+
+    private:
+        friend class FFTWPlanner;
+
+        std::atomic<Plan> plan { nullptr };
+
+        /** Kept alive after the upgrade, since a worker may still be executing it */
+        Plan estimatePlan = nullptr;
+
+        int fftLen = 0;
+        int numTransforms = 0;
+        int rowStride = 0;
+    };
+
+    /** Returns the planner shared by all instances of the plugin */
+    static FFTWPlanner& getInstance();
+
+    /** Has the planner thread destroy a plan that is no longer executed (any thread) */
+    void destroyPlan (Plan plan);
+
+    /** Loads the wisdom file, if this has not been done yet */
+    void loadWisdom();
+
+    /** Returns the smallest length of at least minimumLength whose only prime factors are 2, 3, 5 and 7,
+        which FFTW transforms with its fastest codelets */
+    static int getFastLength (int minimumLength);
+
+    /** Plans numTransforms in-place transforms of length fftLen whose rows are rowStride samples apart */
+    std::shared_ptr<BatchPlan> planBatch (int fftLen, int numTransforms, int rowStride, SpectrumSample* firstRow);
+
+private:
+    /** Constructor */
+    FFTWPlanner();
+
+    /** Destructor */
+    ~FFTWPlanner();
+
+    /** Destroys retired plans and measures the plans that were not covered by wisdom */
+    void run() override;
+
+    /** Destroys the plans handed to destroyPlan(); the planner lock must be held */
+    void destroyRetiredPlans();
+
+    /** Starts the thread if needed and wakes it */
+    void wakeUp();
+
+    /** Returns the location of the wisdom file */
+    File getWisdomFile() const;
+
+    static Plan createPlan (const BatchPlan& batch, SpectrumSample* firstRow, unsigned flags);
+
+    CriticalSection plannerLock;
+    CriticalSection queueLock;
+
+    std::vector<std::weak_ptr<BatchPlan>> pendingPlans;
+
+    /** Plans waiting to be destroyed on the planner thread, guarded by queueLock */
+    std::vector<Plan> retiredPlans;
+
+    std::atomic<bool> wisdomLoaded { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFTWPlanner);
+};
+
+#endif // FFTW_PLANNER_H_INCLUDED
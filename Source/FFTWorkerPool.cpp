@@ -0,0 +1,126 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "FFTWorkerPool.h"
+
+FFTWorkerPool::~FFTWorkerPool()
+{
+    stop();
+}
+
+void FFTWorkerPool::start (int numWorkers_)
+{
+    stop();
+
+    numWorkers = jmax (1, numWorkers_);
+    ranges.reset (new TaskRange[numWorkers]);
+
+    for (int i = 1; i < numWorkers; i++)
+    {
+        workers.add (new Worker (this, i));
+        workers.getLast()->startThread();
+    }
+}
+
+void FFTWorkerPool::stop()
+{
+    for (auto* worker : workers)
+    {
+        worker->signalThreadShouldExit();
+        worker->batchReady.signal();
+    }
+
+    for (auto* worker : workers)
+        worker->stopThread (1000);
+
+    workers.clear();
+    numWorkers = 1;
+}
+
+void FFTWorkerPool::run (Job* job, int numTasks)
+{
+    if (numTasks <= 0)
+        return;
+
+    if (ranges == nullptr)
+        ranges.reset (new TaskRange[numWorkers]);
+
+    currentJob = job;
+
+    // give each worker an equal share to start from
+    for (int i = 0; i < numWorkers; i++)
+    {
+        ranges[i].next.store (int ((int64) i * numTasks / numWorkers), std::memory_order_relaxed);
+        ranges[i].end = int ((int64) (i + 1) * numTasks / numWorkers);
+    }
+
+    activeWorkers = numWorkers;
+
+    for (auto* worker : workers)
+        worker->batchReady.signal();
+
+    processTasks (0);
+
+    if (activeWorkers.fetch_sub (1) != 1)
+        batchFinished.wait (-1);
+}
+
+void FFTWorkerPool::processTasks (int worker)
+{
+    for (int i = 0; i < numWorkers; i++)
+    {
+        TaskRange& range = ranges[(worker + i) % numWorkers];
+
+        int task;
+
+        while ((task = range.next.fetch_add (1, std::memory_order_relaxed)) < range.end)
+        {
+            currentJob->processTask (task, worker);
+        }
+    }
+}
+
+void FFTWorkerPool::workerFinished()
+{
+    if (activeWorkers.fetch_sub (1) == 1)
+        batchFinished.signal();
+}
+
+FFTWorkerPool::Worker::Worker (FFTWorkerPool* pool_, int index_)
+    : Thread ("FFT Worker " + String (index_)), pool (pool_), index (index_)
+{
+}
+
+void FFTWorkerPool::Worker::run()
+{
+    while (! threadShouldExit())
+    {
+        batchReady.wait (-1);
+
+        if (threadShouldExit())
+            break;
+
+        pool->processTasks (index);
+        pool->workerFinished();
+    }
+}
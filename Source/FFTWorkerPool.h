@@ -0,0 +1,110 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef FFT_WORKER_POOL_H_INCLUDED
+#define FFT_WORKER_POOL_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include <atomic>
+#include <memory>
+
+/*
+	Runs batches of independent tasks on a fixed set of worker threads.
+
+	Each worker starts on its own contiguous range of the batch and steals
+	from the other ranges once its own is exhausted. The thread that calls
+	run() takes part as worker 0, so a pool with one worker runs everything
+	on the calling thread.
+*/
+class FFTWorkerPool
+{
+public:
+    /** Work to be split across the pool */
+    class Job
+    {
+    public:
+        virtual ~Job() {}
+
+        /** Called exactly once for every task of a batch, from any worker */
+        virtual void processTask (int task, int worker) = 0;
+    };
+
+    /** Constructor */
+    FFTWorkerPool() {}
+
+    /** Destructor */
+    ~FFTWorkerPool();
+
+    /** Launches numWorkers - 1 threads */
+    void start (int numWorkers);
+
+    /** Stops all threads */
+    void stop();
+
+    /** Returns the number of workers, including the calling thread */
+    int getNumWorkers() const { return numWorkers; }
+
+    /** Runs tasks 0 to numTasks - 1 and returns once all of them have finished */
+    void run (Job* job, int numTasks);
+
+private:
+    class Worker : public Thread
+    {
+    public:
+        Worker (FFTWorkerPool* pool, int index);
+
+        void run() override;
+
+        WaitableEvent batchReady;
+
+    private:
+        FFTWorkerPool* pool;
+        const int index;
+    };
+
+    /** Claims tasks from every range, starting with the worker's own */
+    void processTasks (int worker);
+
+    /** Called by each worker when it finds no more tasks */
+    void workerFinished();
+
+    struct alignas (64) TaskRange
+    {
+        std::atomic<int> next { 0 };
+        int end = 0;
+    };
+
+    OwnedArray<Worker> workers;
+    std::unique_ptr<TaskRange[]> ranges;
+
+    Job* currentJob = nullptr;
+    int numWorkers = 1;
+
+    std::atomic<int> activeWorkers { 0 };
+    WaitableEvent batchFinished;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFTWorkerPool);
+};
+
+#endif // FFT_WORKER_POOL_H_INCLUDED
@@ -0,0 +1,95 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef FRAME_FIFO_H_INCLUDED
+#define FRAME_FIFO_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+/*
+	Lock-free queue of fixed-size frames for one producer and one consumer.
+
+	Frames are read in the order they were written. All storage is allocated
+	up front; if the consumer falls behind, new frames are dropped.
+*/
+template <typename ValueType>
+class FrameQueue
+{
+public:
+    /** Constructor */
+    FrameQueue (int numFrames, int frameSize_)
+        : fifo (numFrames + 1), frameSize (frameSize_), data ((size_t) (numFrames + 1) * frameSize_, true)
+    {
+    }
+
+    /** Returns the next frame to write, or nullptr if the queue is full (producer) */
+    ValueType* getWritePointer()
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite (1, start1, size1, start2, size2);
+
+        if (size1 == 0)
+            return nullptr;
+
+        return data + (size_t) start1 * frameSize;
+    }
+
+    /** Makes the frame returned by getWritePointer() available to the consumer */
+    void finishedWrite() { fifo.finishedWrite (1); }
+
+    /** Returns the oldest unread frame, or nullptr if there is none (consumer) */
+    const ValueType* getReadPointer()
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead (1, start1, size1, start2, size2);
+
+        if (size1 == 0)
+            return nullptr;
+
+        return data + (size_t) start1 * frameSize;
+    }
+
+    /** Releases the frame returned by getReadPointer() */
+    void finishedRead() { fifo.finishedRead (1); }
+
+    /** Returns the number of frames waiting to be read */
+    int getNumReady() const { return fifo.getNumReady(); }
+
+    /** Returns the number of values in each frame */
+    int getFrameSize() const { return frameSize; }
+
+    /** Discards all frames. No reader or writer may be active. */
+    void reset() { fifo.reset(); }
+
+private:
+    AbstractFifo fifo;
+    const int frameSize;
+    HeapBlock<ValueType> data;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FrameQueue);
+};
+
+/** Queue of power or coherence frames */
+using FrameFifo = FrameQueue<float>;
+
+#endif // FRAME_FIFO_H_INCLUDED
@@ -0,0 +1,96 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef FRAME_NOTIFIER_H_INCLUDED
+#define FRAME_NOTIFIER_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include <atomic>
+
+/*
+	Lets producers wake a single consumer thread that sleeps until there is work.
+
+	The signal count is kept in an atomic, so signal() is a single atomic
+	increment unless the consumer is actually asleep; only then is the
+	underlying event posted, at most once per sleep. wait() consumes every
+	signal that arrived since the previous call and only blocks if there
+	were none.
+*/
+class FrameNotifier
+{
+public:
+    /** Constructor */
+    FrameNotifier() {}
+
+    /** Reports that new work is available (any thread) */
+    void signal()
+    {
+        if (count.fetch_add (1, std::memory_order_release) < 0)
+            event.signal();
+    }
+
+    /** Blocks until signal() is called or the timeout expires (consumer thread only).
+        Returns true if a signal was received. */
+    bool wait (int timeOutMilliseconds)
+    {
+        int pending = count.load (std::memory_order_relaxed);
+
+        while (pending > 0)
+        {
+            if (count.compare_exchange_weak (pending, 0, std::memory_order_acquire))
+                return true;
+        }
+
+        // announce that we are going to sleep
+        if (count.fetch_sub (1, std::memory_order_acquire) > 0)
+        {
+            // a signal arrived in the meantime
+            count.exchange (0, std::memory_order_acquire);
+            return true;
+        }
+
+        if (event.wait (timeOutMilliseconds))
+            return true;
+
+        // timed out: withdraw the announcement, unless a producer has just seen it
+        int expected = -1;
+
+        if (count.compare_exchange_strong (expected, 0, std::memory_order_acquire))
+            return false;
+
+        // that producer is posting the event, consume it
+        event.wait (-1);
+        return true;
+    }
+
+private:
+    /** Number of pending signals, or -1 while the consumer is asleep */
+    std::atomic<int> count { 0 };
+
+    WaitableEvent event;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FrameNotifier);
+};
+
+#endif // FRAME_NOTIFIER_H_INCLUDED
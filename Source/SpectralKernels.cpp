@@ -0,0 +1,550 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "SpectralKernels.h"
+
+#include <cmath>
+
+#if defined(_MSC_VER) && ! defined(__clang__)
+#define SPECTRAL_NOINLINE __declspec (noinline)
+#else
+#define SPECTRAL_NOINLINE __attribute__ ((noinline))
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SPECTRAL_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && ! defined(__clang__)
+#define SPECTRAL_TARGET_AVX2
+#define SPECTRAL_TARGET_AVX512
+#else
+#define SPECTRAL_TARGET_AVX2 __attribute__ ((target ("avx2,fma")))
+#define SPECTRAL_TARGET_AVX512 __attribute__ ((target ("avx512f")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SPECTRAL_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace SpectralKernels
+{
+// Cephes logf: log(1 + x) for x in [sqrt(0.5) - 1, sqrt(2) - 1]
+static const float LOG_P0 = 7.0376836292E-2f;
+static const float LOG_P1 = -1.1514610310E-1f;
+static const float LOG_P2 = 1.1676998740E-1f;
+static const float LOG_P3 = -1.2420140846E-1f;
+static const float LOG_P4 = 1.4249322787E-1f;
+static const float LOG_P5 = -1.6668057665E-1f;
+static const float LOG_P6 = 2.0000714765E-1f;
+static const float LOG_P7 = -2.4999993993E-1f;
+static const float LOG_P8 = 3.3333331174E-1f;
+static const float LOG_Q1 = -2.12194440E-4f;
+static const float LOG_Q2 = 0.693359375f;
+static const float SQRT_HALF = 0.707106781186547524f;
+static const float DECIBELS_PER_NEPER = 4.342944819032518f; // 10 / ln(10)
+
+// > Reference
+
+// Not inlined, so the tails of the AVX2 loops are not contracted into FMAs
+// and round exactly like the reference
+template <typename SampleType>
+SPECTRAL_NOINLINE static void applyWindowScalar (const float* samples, const float* window, SampleType* dest, int numSamples)
+{
+    for (int n = 0; n < numSamples; n++)
+        dest[n] = samples[n] * window[n];
+}
+
+template <typename SampleType>
+SPECTRAL_NOINLINE static void complexPowerScalar (const SampleType* spectrum, SampleType* dest, int numBins)
+{
+    for (int k = 0; k < numBins; k++)
+    {
+        const SampleType re = spectrum[2 * k];
+        const SampleType im = spectrum[2 * k + 1];
+
+        dest[k] = re * re + im * im;
+    }
+}
+
+void Reference::applyWindow (const float* samples, const float* window, double* dest, int numSamples)
+{
+    applyWindowScalar (samples, window, dest, numSamples);
+}
+
+void Reference::applyWindow (const float* samples, const float* window, float* dest, int numSamples)
+{
+    applyWindowScalar (samples, window, dest, numSamples);
+}
+
+void Reference::complexPower (const double* spectrum, double* dest, int numBins)
+{
+    complexPowerScalar (spectrum, dest, numBins);
+}
+
+void Reference::complexPower (const float* spectrum, float* dest, int numBins)
+{
+    complexPowerScalar (spectrum, dest, numBins);
+}
+
+void Reference::log (const float* values, float* dest, int numValues)
+{
+    for (int n = 0; n < numValues; n++)
+        dest[n] = std::log (values[n]);
+}
+
+void Reference::decibels (const float* values, float* dest, int numValues)
+{
+    for (int n = 0; n < numValues; n++)
+        dest[n] = DECIBELS_PER_NEPER * std::log (values[n]);
+}
+
+#if SPECTRAL_KERNELS_X86
+
+// > AVX2
+
+SPECTRAL_TARGET_AVX2 static void applyWindowAVX2 (const float* samples, const float* window, double* dest, int numSamples)
+{
+    int n = 0;
+
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        const __m256 product = _mm256_mul_ps (_mm256_loadu_ps (samples + n), _mm256_loadu_ps (window + n));
+
+        _mm256_storeu_pd (dest + n, _mm256_cvtps_pd (_mm256_castps256_ps128 (product)));
+        _mm256_storeu_pd (dest + n + 4, _mm256_cvtps_pd (_mm256_extractf128_ps (product, 1)));
+    }
+
+    Reference::applyWindow (samples + n, window + n, dest + n, numSamples - n);
+}
+
+SPECTRAL_TARGET_AVX2 static void complexPowerAVX2 (const double* spectrum, double* dest, int numBins)
+{
+    int k = 0;
+
+    for (; k + 4 <= numBins; k += 4)
+    {
+        const __m256d a = _mm256_loadu_pd (spectrum + 2 * k);
+        const __m256d b = _mm256_loadu_pd (spectrum + 2 * k + 4);
+
+        // [|a0|, |b0|, |a1|, |b1|] squared, then reordered to [a0, a1, b0, b1]
+        const __m256d sums = _mm256_hadd_pd (_mm256_mul_pd (a, a), _mm256_mul_pd (b, b));
+
+        _mm256_storeu_pd (dest + k, _mm256_permute4x64_pd (sums, 0xD8));
+    }
+
+    Reference::complexPower (spectrum + 2 * k, dest + k, numBins - k);
+}
+
+SPECTRAL_TARGET_AVX2 static void applyWindowFloatAVX2 (const float* samples, const float* window, float* dest, int numSamples)
+{
+    int n = 0;
+
+    for (; n + 8 <= numSamples; n += 8)
+        _mm256_storeu_ps (dest + n, _mm256_mul_ps (_mm256_loadu_ps (samples + n), _mm256_loadu_ps (window + n)));
+
+    Reference::applyWindow (samples + n, window + n, dest + n, numSamples - n);
+}
+
+SPECTRAL_TARGET_AVX2 static void complexPowerFloatAVX2 (const float* spectrum, float* dest, int numBins)
+{
+    int k = 0;
+
+    for (; k + 8 <= numBins; k += 8)
+    {
+        const __m256 a = _mm256_loadu_ps (spectrum + 2 * k);
+        const __m256 b = _mm256_loadu_ps (spectrum + 2 * k + 8);
+
+        // [a0, a1, b0, b1 | a2, a3, b2, b3], then reordered by pairs to [a0 .. a3, b0 .. b3]
+        const __m256 sums = _mm256_hadd_ps (_mm256_mul_ps (a, a), _mm256_mul_ps (b, b));
+
+        _mm256_storeu_ps (dest + k, _mm256_castpd_ps (_mm256_permute4x64_pd (_mm256_castps_pd (sums), 0xD8)));
+    }
+
+    Reference::complexPower (spectrum + 2 * k, dest + k, numBins - k);
+}
+
+SPECTRAL_TARGET_AVX2 static inline __m256 log8 (__m256 x)
+{
+    const __m256 one = _mm256_set1_ps (1.0f);
+
+    // split into a mantissa in [0.5, 1) and an exponent
+    x = _mm256_max_ps (x, _mm256_castsi256_ps (_mm256_set1_epi32 (0x00800000)));
+    const __m256i exponent = _mm256_sub_epi32 (_mm256_srli_epi32 (_mm256_castps_si256 (x), 23), _mm256_set1_epi32 (126));
+    x = _mm256_or_ps (_mm256_and_ps (x, _mm256_castsi256_ps (_mm256_set1_epi32 (0x007fffff))), _mm256_set1_ps (0.5f));
+    __m256 e = _mm256_cvtepi32_ps (exponent);
+
+    // move the mantissa into [sqrt(0.5), sqrt(2))
+    const __m256 small = _mm256_cmp_ps (x, _mm256_set1_ps (SQRT_HALF), _CMP_LT_OQ);
+    e = _mm256_sub_ps (e, _mm256_and_ps (one, small));
+    x = _mm256_add_ps (_mm256_sub_ps (x, one), _mm256_and_ps (x, small));
+
+    const __m256 z = _mm256_mul_ps (x, x);
+
+    __m256 y = _mm256_set1_ps (LOG_P0);
+    y = _mm256_fmadd_ps (y, x, _mm256_set1_ps (LOG_P1));
+    y = _mm256_fmadd_ps (y, x, _mm256_set1_ps (LOG_P2));
+    y = _mm256_fmadd_ps (y, x, _mm256_set1_ps (LOG_P3));
+    y = _mm256_fmadd_ps (y, x, _mm256_set1_ps (LOG_P4));
+    y = _mm256_fmadd_ps (y, x, _mm256_set1_ps (LOG_P5));
+    y = _mm256_fmadd_ps (y, x, _mm256_set1_ps (LOG_P6));
+    y = _mm256_fmadd_ps (y, x, _mm256_set1_ps (LOG_P7));
+    y = _mm256_fmadd_ps (y, x, _mm256_set1_ps (LOG_P8));
+    y = _mm256_mul_ps (_mm256_mul_ps (y, x), z);
+
+    y = _mm256_fmadd_ps (e, _mm256_set1_ps (LOG_Q1), y);
+    y = _mm256_fnmadd_ps (z, _mm256_set1_ps (0.5f), y);
+
+    return _mm256_fmadd_ps (e, _mm256_set1_ps (LOG_Q2), _mm256_add_ps (x, y));
+}
+
+SPECTRAL_TARGET_AVX2 static void logAVX2 (const float* values, float* dest, int numValues)
+{
+    int n = 0;
+
+    for (; n + 8 <= numValues; n += 8)
+        _mm256_storeu_ps (dest + n, log8 (_mm256_loadu_ps (values + n)));
+
+    Reference::log (values + n, dest + n, numValues - n);
+}
+
+SPECTRAL_TARGET_AVX2 static void decibelsAVX2 (const float* values, float* dest, int numValues)
+{
+    const __m256 scale = _mm256_set1_ps (DECIBELS_PER_NEPER);
+    int n = 0;
+
+    for (; n + 8 <= numValues; n += 8)
+        _mm256_storeu_ps (dest + n, _mm256_mul_ps (scale, log8 (_mm256_loadu_ps (values + n))));
+
+    Reference::decibels (values + n, dest + n, numValues - n);
+}
+
+// > AVX-512
+
+SPECTRAL_TARGET_AVX512 static void applyWindowAVX512 (const float* samples, const float* window, double* dest, int numSamples)
+{
+    int n = 0;
+
+    for (; n + 16 <= numSamples; n += 16)
+    {
+        const __m512 product = _mm512_mul_ps (_mm512_loadu_ps (samples + n), _mm512_loadu_ps (window + n));
+        const __m256 high = _mm256_castpd_ps (_mm512_extractf64x4_pd (_mm512_castps_pd (product), 1));
+
+        _mm512_storeu_pd (dest + n, _mm512_cvtps_pd (_mm512_castps512_ps256 (product)));
+        _mm512_storeu_pd (dest + n + 8, _mm512_cvtps_pd (high));
+    }
+
+    Reference::applyWindow (samples + n, window + n, dest + n, numSamples - n);
+}
+
+SPECTRAL_TARGET_AVX512 static void complexPowerAVX512 (const double* spectrum, double* dest, int numBins)
+{
+    const __m512i realIndex = _mm512_set_epi64 (14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i imagIndex = _mm512_set_epi64 (15, 13, 11, 9, 7, 5, 3, 1);
+    int k = 0;
+
+    for (; k + 8 <= numBins; k += 8)
+    {
+        const __m512d a = _mm512_loadu_pd (spectrum + 2 * k);
+        const __m512d b = _mm512_loadu_pd (spectrum + 2 * k + 8);
+
+        // square before separating real and imaginary parts, so the sum cannot become an FMA
+        const __m512d aa = _mm512_mul_pd (a, a);
+        const __m512d bb = _mm512_mul_pd (b, b);
+
+        _mm512_storeu_pd (dest + k, _mm512_add_pd (_mm512_permutex2var_pd (aa, realIndex, bb), _mm512_permutex2var_pd (aa, imagIndex, bb)));
+    }
+
+    Reference::complexPower (spectrum + 2 * k, dest + k, numBins - k);
+}
+
+SPECTRAL_TARGET_AVX512 static void applyWindowFloatAVX512 (const float* samples, const float* window, float* dest, int numSamples)
+{
+    int n = 0;
+
+    for (; n + 16 <= numSamples; n += 16)
+        _mm512_storeu_ps (dest + n, _mm512_mul_ps (_mm512_loadu_ps (samples + n), _mm512_loadu_ps (window + n)));
+
+    Reference::applyWindow (samples + n, window + n, dest + n, numSamples - n);
+}
+
+SPECTRAL_TARGET_AVX512 static void complexPowerFloatAVX512 (const float* spectrum, float* dest, int numBins)
+{
+    const __m512i realIndex = _mm512_set_epi32 (30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i imagIndex = _mm512_set_epi32 (31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+    int k = 0;
+
+    for (; k + 16 <= numBins; k += 16)
+    {
+        const __m512 a = _mm512_loadu_ps (spectrum + 2 * k);
+        const __m512 b = _mm512_loadu_ps (spectrum + 2 * k + 16);
+        const __m512 aa = _mm512_mul_ps (a, a);
+        const __m512 bb = _mm512_mul_ps (b, b);
+
+        _mm512_storeu_ps (dest + k, _mm512_add_ps (_mm512_permutex2var_ps (aa, realIndex, bb), _mm512_permutex2var_ps (aa, imagIndex, bb)));
+    }
+
+    Reference::complexPower (spectrum + 2 * k, dest + k, numBins - k);
+}
+
+SPECTRAL_TARGET_AVX512 static inline __m512 log16 (__m512 x)
+{
+    const __m512 one = _mm512_set1_ps (1.0f);
+
+    // split into a mantissa in [0.5, 1) and an exponent
+    x = _mm512_max_ps (x, _mm512_castsi512_ps (_mm512_set1_epi32 (0x00800000)));
+    const __m512i bits = _mm512_castps_si512 (x);
+    const __m512i exponent = _mm512_sub_epi32 (_mm512_srli_epi32 (bits, 23), _mm512_set1_epi32 (126));
+    x = _mm512_castsi512_ps (_mm512_or_si512 (_mm512_and_si512 (bits, _mm512_set1_epi32 (0x007fffff)), _mm512_set1_epi32 (0x3f000000)));
+    __m512 e = _mm512_cvtepi32_ps (exponent);
+
+    // move the mantissa into [sqrt(0.5), sqrt(2))
+    const __mmask16 small = _mm512_cmp_ps_mask (x, _mm512_set1_ps (SQRT_HALF), _CMP_LT_OQ);
+    e = _mm512_mask_sub_ps (e, small, e, one);
+    x = _mm512_mask_add_ps (_mm512_sub_ps (x, one), small, _mm512_sub_ps (x, one), x);
+
+    const __m512 z = _mm512_mul_ps (x, x);
+
+    __m512 y = _mm512_set1_ps (LOG_P0);
+    y = _mm512_fmadd_ps (y, x, _mm512_set1_ps (LOG_P1));
+    y = _mm512_fmadd_ps (y, x, _mm512_set1_ps (LOG_P2));
+    y = _mm512_fmadd_ps (y, x, _mm512_set1_ps (LOG_P3));
+    y = _mm512_fmadd_ps (y, x, _mm512_set1_ps (LOG_P4));
+    y = _mm512_fmadd_ps (y, x, _mm512_set1_ps (LOG_P5));
+    y = _mm512_fmadd_ps (y, x, _mm512_set1_ps (LOG_P6));
+    y = _mm512_fmadd_ps (y, x, _mm512_set1_ps (LOG_P7));
+    y = _mm512_fmadd_ps (y, x, _mm512_set1_ps (LOG_P8));
+    y = _mm512_mul_ps (_mm512_mul_ps (y, x), z);
+
+    y = _mm512_fmadd_ps (e, _mm512_set1_ps (LOG_Q1), y);
+    y = _mm512_fnmadd_ps (z, _mm512_set1_ps (0.5f), y);
+
+    return _mm512_fmadd_ps (e, _mm512_set1_ps (LOG_Q2), _mm512_add_ps (x, y));
+}
+
+SPECTRAL_TARGET_AVX512 static void logAVX512 (const float* values, float* dest, int numValues)
+{
+    int n = 0;
+
+    for (; n + 16 <= numValues; n += 16)
+        _mm512_storeu_ps (dest + n, log16 (_mm512_loadu_ps (values + n)));
+
+    Reference::log (values + n, dest + n, numValues - n);
+}
+
+SPECTRAL_TARGET_AVX512 static void decibelsAVX512 (const float* values, float* dest, int numValues)
+{
+    const __m512 scale = _mm512_set1_ps (DECIBELS_PER_NEPER);
+    int n = 0;
+
+    for (; n + 16 <= numValues; n += 16)
+        _mm512_storeu_ps (dest + n, _mm512_mul_ps (scale, log16 (_mm512_loadu_ps (values + n))));
+
+    Reference::decibels (values + n, dest + n, numValues - n);
+}
+
+#elif SPECTRAL_KERNELS_NEON
+
+// > NEON
+
+static void applyWindowNEON (const float* samples, const float* window, double* dest, int numSamples)
+{
+    int n = 0;
+
+    for (; n + 4 <= numSamples; n += 4)
+    {
+        const float32x4_t product = vmulq_f32 (vld1q_f32 (samples + n), vld1q_f32 (window + n));
+
+        vst1q_f64 (dest + n, vcvt_f64_f32 (vget_low_f32 (product)));
+        vst1q_f64 (dest + n + 2, vcvt_high_f64_f32 (product));
+    }
+
+    Reference::applyWindow (samples + n, window + n, dest + n, numSamples - n);
+}
+
+static void complexPowerNEON (const double* spectrum, double* dest, int numBins)
+{
+    int k = 0;
+
+    for (; k + 2 <= numBins; k += 2)
+    {
+        const float64x2_t a = vld1q_f64 (spectrum + 2 * k);
+        const float64x2_t b = vld1q_f64 (spectrum + 2 * k + 2);
+
+        // pairwise sums of the squares, which cannot become an FMA
+        vst1q_f64 (dest + k, vpaddq_f64 (vmulq_f64 (a, a), vmulq_f64 (b, b)));
+    }
+
+    Reference::complexPower (spectrum + 2 * k, dest + k, numBins - k);
+}
+
+static void applyWindowFloatNEON (const float* samples, const float* window, float* dest, int numSamples)
+{
+    int n = 0;
+
+    for (; n + 4 <= numSamples; n += 4)
+        vst1q_f32 (dest + n, vmulq_f32 (vld1q_f32 (samples + n), vld1q_f32 (window + n)));
+
+    Reference::applyWindow (samples + n, window + n, dest + n, numSamples - n);
+}
+
+static void complexPowerFloatNEON (const float* spectrum, float* dest, int numBins)
+{
+    int k = 0;
+
+    for (; k + 4 <= numBins; k += 4)
+    {
+        const float32x4_t a = vld1q_f32 (spectrum + 2 * k);
+        const float32x4_t b = vld1q_f32 (spectrum + 2 * k + 4);
+
+        vst1q_f32 (dest + k, vpaddq_f32 (vmulq_f32 (a, a), vmulq_f32 (b, b)));
+    }
+
+    Reference::complexPower (spectrum + 2 * k, dest + k, numBins - k);
+}
+
+static inline float32x4_t log4 (float32x4_t x)
+{
+    const float32x4_t one = vdupq_n_f32 (1.0f);
+
+    // split into a mantissa in [0.5, 1) and an exponent
+    x = vmaxq_f32 (x, vreinterpretq_f32_u32 (vdupq_n_u32 (0x00800000)));
+    const uint32x4_t bits = vreinterpretq_u32_f32 (x);
+    const int32x4_t exponent = vsubq_s32 (vreinterpretq_s32_u32 (vshrq_n_u32 (bits, 23)), vdupq_n_s32 (126));
+    x = vreinterpretq_f32_u32 (vorrq_u32 (vandq_u32 (bits, vdupq_n_u32 (0x007fffff)), vdupq_n_u32 (0x3f000000)));
+    float32x4_t e = vcvtq_f32_s32 (exponent);
+
+    // move the mantissa into [sqrt(0.5), sqrt(2))
+    const uint32x4_t small = vcltq_f32 (x, vdupq_n_f32 (SQRT_HALF));
+    e = vsubq_f32 (e, vreinterpretq_f32_u32 (vandq_u32 (vreinterpretq_u32_f32 (one), small)));
+    x = vaddq_f32 (vsubq_f32 (x, one), vreinterpretq_f32_u32 (vandq_u32 (vreinterpretq_u32_f32 (x), small)));
+
+    const float32x4_t z = vmulq_f32 (x, x);
+
+    float32x4_t y = vdupq_n_f32 (LOG_P0);
+    y = vfmaq_f32 (vdupq_n_f32 (LOG_P1), y, x);
+    y = vfmaq_f32 (vdupq_n_f32 (LOG_P2), y, x);
+    y = vfmaq_f32 (vdupq_n_f32 (LOG_P3), y, x);
+    y = vfmaq_f32 (vdupq_n_f32 (LOG_P4), y, x);
+    y = vfmaq_f32 (vdupq_n_f32 (LOG_P5), y, x);
+    y = vfmaq_f32 (vdupq_n_f32 (LOG_P6), y, x);
+    y = vfmaq_f32 (vdupq_n_f32 (LOG_P7), y, x);
+    y = vfmaq_f32 (vdupq_n_f32 (LOG_P8), y, x);
+    y = vmulq_f32 (vmulq_f32 (y, x), z);
+
+    y = vfmaq_f32 (y, e, vdupq_n_f32 (LOG_Q1));
+    y = vfmsq_f32 (y, z, vdupq_n_f32 (0.5f));
+
+    return vfmaq_f32 (vaddq_f32 (x, y), e, vdupq_n_f32 (LOG_Q2));
+}
+
+static void logNEON (const float* values, float* dest, int numValues)
+{
+    int n = 0;
+
+    for (; n + 4 <= numValues; n += 4)
+        vst1q_f32 (dest + n, log4 (vld1q_f32 (values + n)));
+
+    Reference::log (values + n, dest + n, numValues - n);
+}
+
+static void decibelsNEON (const float* values, float* dest, int numValues)
+{
+    int n = 0;
+
+    for (; n + 4 <= numValues; n += 4)
+        vst1q_f32 (dest + n, vmulq_n_f32 (log4 (vld1q_f32 (values + n)), DECIBELS_PER_NEPER));
+
+    Reference::decibels (values + n, dest + n, numValues - n);
+}
+
+#endif
+
+// > Dispatch
+
+struct KernelTable
+{
+    void (*applyWindow) (const float*, const float*, double*, int);
+    void (*applyWindowFloat) (const float*, const float*, float*, int);
+    void (*complexPower) (const double*, double*, int);
+    void (*complexPowerFloat) (const float*, float*, int);
+    void (*log) (const float*, float*, int);
+    void (*decibels) (const float*, float*, int);
+    const char* name;
+};
+
+static KernelTable selectKernels()
+{
+#if SPECTRAL_KERNELS_X86
+    if (SystemStats::hasAVX512F())
+        return { applyWindowAVX512, applyWindowFloatAVX512, complexPowerAVX512, complexPowerFloatAVX512, logAVX512, decibelsAVX512, "AVX-512" };
+
+    if (SystemStats::hasAVX2() && SystemStats::hasFMA3())
+        return { applyWindowAVX2, applyWindowFloatAVX2, complexPowerAVX2, complexPowerFloatAVX2, logAVX2, decibelsAVX2, "AVX2" };
+#elif SPECTRAL_KERNELS_NEON
+    return { applyWindowNEON, applyWindowFloatNEON, complexPowerNEON, complexPowerFloatNEON, logNEON, decibelsNEON, "NEON" };
+#endif
+
+    return { Reference::applyWindow, Reference::applyWindow, Reference::complexPower, Reference::complexPower, Reference::log, Reference::decibels, "scalar" };
+}
+
+static const KernelTable& getKernels()
+{
+    static const KernelTable kernels = selectKernels();
+    return kernels;
+}
+
+void applyWindow (const float* samples, const float* window, double* dest, int numSamples)
+{
+    getKernels().applyWindow (samples, window, dest, numSamples);
+}
+
+void applyWindow (const float* samples, const float* window, float* dest, int numSamples)
+{
+    getKernels().applyWindowFloat (samples, window, dest, numSamples);
+}
+
+void complexPower (const double* spectrum, double* dest, int numBins)
+{
+    getKernels().complexPower (spectrum, dest, numBins);
+}
+
+void complexPower (const float* spectrum, float* dest, int numBins)
+{
+    getKernels().complexPowerFloat (spectrum, dest, numBins);
+}
+
+void log (const float* values, float* dest, int numValues)
+{
+    getKernels().log (values, dest, numValues);
+}
+
+void decibels (const float* values, float* dest, int numValues)
+{
+    getKernels().decibels (values, dest, numValues);
+}
+
+String getInstructionSetName()
+{
+    return getKernels().name;
+}
+} // namespace SpectralKernels
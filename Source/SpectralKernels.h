@@ -0,0 +1,74 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SPECTRAL_KERNELS_H_INCLUDED
+#define SPECTRAL_KERNELS_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+/*
+	Vectorized inner loops of the spectral pipeline.
+
+	Each kernel has a scalar reference in SpectralKernels::Reference and
+	AVX2, AVX-512 and NEON variants. The fastest variant supported by the
+	CPU is picked the first time any kernel is called. Windowing and power
+	give exactly the same results as the reference; log and decibels are
+	within a few ulp of std::log for positive, finite inputs.
+*/
+namespace SpectralKernels
+{
+/** Writes dest[n] = samples[n] * window[n], widened to double */
+void applyWindow (const float* samples, const float* window, double* dest, int numSamples);
+
+/** Writes dest[n] = samples[n] * window[n] */
+void applyWindow (const float* samples, const float* window, float* dest, int numSamples);
+
+/** Writes the squared magnitude of numBins interleaved complex values.
+    dest may be the same array as spectrum. */
+void complexPower (const double* spectrum, double* dest, int numBins);
+
+/** Single-precision version of complexPower */
+void complexPower (const float* spectrum, float* dest, int numBins);
+
+/** Writes the natural log of each value, which must be positive and finite */
+void log (const float* values, float* dest, int numValues);
+
+/** Writes 10 log10 of each value, which must be positive and finite */
+void decibels (const float* values, float* dest, int numValues);
+
+/** Returns the name of the instruction set the kernels use on this CPU */
+String getInstructionSetName();
+
+/** Plain C++ versions, used for the tails of the vectorized loops and when no SIMD is available */
+namespace Reference
+{
+    void applyWindow (const float* samples, const float* window, double* dest, int numSamples);
+    void applyWindow (const float* samples, const float* window, float* dest, int numSamples);
+    void complexPower (const double* spectrum, double* dest, int numBins);
+    void complexPower (const float* spectrum, float* dest, int numBins);
+    void log (const float* values, float* dest, int numValues);
+    void decibels (const float* values, float* dest, int numValues);
+} // namespace Reference
+} // namespace SpectralKernels
+
+#endif // SPECTRAL_KERNELS_H_INCLUDED
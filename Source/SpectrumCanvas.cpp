@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "SpectrumCanvas.h"
+#include "SpectralKernels.h"
 #include <math.h>
 
 SpectrumCanvas::SpectrumCanvas (SpectrumViewer* n)
@@ -29,13 +30,17 @@ SpectrumCanvas::SpectrumCanvas (SpectrumViewer* n)
 {
     refreshRate = 60;
 
-    canvasPlot = std::make_unique<CanvasPlot> (processor);
+    plotHolder = std::make_unique<Component>();
 
     viewport = std::make_unique<Viewport>();
-    viewport->setViewedComponent (canvasPlot.get(), true);
+    viewport->setViewedComponent (plotHolder.get(), false);
     viewport->setScrollBarsShown (true, true);
     viewport->setScrollBarThickness (12);
     addAndMakeVisible (viewport.get());
+
+    renderer = std::make_unique<CanvasRenderer> (canvasPlots);
+
+    updatePlots();
 }
 
 void SpectrumCanvas::resized()
@@ -44,23 +49,55 @@ void SpectrumCanvas::resized()
 
     viewport->setBounds (0, 0, getWidth(), getHeight());
 
-    if (displayType == POWER_SPECTRUM)
+    const int numPlots = jmax (1, canvasPlots.size());
+    int x = 0;
+
+    if (displayType != SPECTROGRAM)
     {
-        if (viewport->getMaximumVisibleWidth() < 840 + canvasPlot->legendWidth)
-            plotWidth = 800;
+        // ranges are shown side by side, sharing the legend of the last one
+        const int legendWidth = canvasPlots.isEmpty() ? 0 : canvasPlots.getLast()->legendWidth;
+        const int minPlotWidth = numPlots > 1 ? 400 : 800;
+
+        if (viewport->getMaximumVisibleWidth() < numPlots * (minPlotWidth + 40) + legendWidth)
+            plotWidth = minPlotWidth;
         else
-            plotWidth = viewport->getMaximumVisibleWidth() - canvasPlot->legendWidth - 40;
+            plotWidth = (viewport->getMaximumVisibleWidth() - legendWidth) / numPlots - 40;
 
         if (viewport->getMaximumVisibleHeight() < 650)
             plotHeight = 600;
         else
             plotHeight = viewport->getMaximumVisibleHeight() - 50;
 
-        canvasPlot->setBounds (0, 0, plotWidth + canvasPlot->legendWidth + 40, plotHeight + 50);
+        for (auto* plot : canvasPlots)
+            plotHeight = jmax (plotHeight, plot->getLegendHeight() - 50);
+
+        for (auto* plot : canvasPlots)
+        {
+            const int width = plotWidth + plot->legendWidth + 40;
+
+            plot->setBounds (x, 0, width, plotHeight + 50);
+            x += width;
+        }
+
+        plotHolder->setSize (x, plotHeight + 50);
     }
     else
     {
-        canvasPlot->setBounds (0, 0, viewport->getMaximumVisibleWidth(), viewport->getMaximumVisibleHeight());
+        const int width = viewport->getMaximumVisibleWidth() / numPlots;
+
+        // every channel's spectrogram is stacked, scrolling once they get too small
+        int height = viewport->getMaximumVisibleHeight();
+
+        for (auto* plot : canvasPlots)
+            height = jmax (height, plot->getSpectrogramHeight());
+
+        for (auto* plot : canvasPlots)
+        {
+            plot->setBounds (x, 0, width, height);
+            x += width;
+        }
+
+        plotHolder->setSize (viewport->getMaximumVisibleWidth(), height);
     }
 }
 
@@ -73,59 +110,65 @@ void SpectrumCanvas::paint (Graphics& g)
 
 void SpectrumCanvas::updateSettings()
 {
-    canvasPlot->updateActiveChans();
+    // the plots' engines and buffers are about to change under the render thread,
+    // and the processor frees the old engines as soon as this returns
+    const bool wasRendering = renderer->isThreadRunning();
+    renderer->stop();
+
+    updatePlots();
+
+    // the zoom band and method can change the frequencies without the editor's frequency range changing
+    for (auto* plot : canvasPlots)
+    {
+        plot->updateFrequencies();
+        plot->updateActiveChans();
+    }
+
+    if (wasRendering)
+        renderer->startThread();
+
+    resized();
+}
+
+void SpectrumCanvas::updatePlots()
+{
+    const int numViews = processor->getNumViews();
+
+    while (canvasPlots.size() > numViews)
+        canvasPlots.removeLast();
+
+    while (canvasPlots.size() < numViews)
+    {
+        auto* plot = canvasPlots.add (new CanvasPlot (processor, canvasPlots.size()));
+        plot->setDisplayType (displayType);
+        plotHolder->addAndMakeVisible (plot);
+    }
+
+    // one legend is enough for every range
+    for (auto* plot : canvasPlots)
+        plot->legendWidth = plot == canvasPlots.getLast() ? 150 : 0;
 }
 
 void SpectrumCanvas::beginAnimation()
 {
-    canvasPlot->clear();
+    for (auto* plot : canvasPlots)
+        plot->clear();
+
+    renderer->startThread();
     startCallbacks();
 }
 
 void SpectrumCanvas::endAnimation()
 {
     stopCallbacks();
+    renderer->stop();
 }
 
 void SpectrumCanvas::refresh()
 {
-    //std::cout << "Refresh." << std::endl;
-
-    bool needsRedraw = false;
-
-    for (int i = 0; i < MAX_CHANS; i++)
-    {
-        SpectrumViewer::PowerBuffer* buffer = &processor->powerBuffers[i];
-
-        for (int j = 0; j < buffer->power.size(); j++)
-        {
-            if (buffer->power[j]->hasUpdate())
-            {
-                AtomicScopedReadPtr<std::vector<float>> powerReader (*buffer->power[j]);
-
-                powerReader.pullUpdate();
-
-                if (powerReader.isValid())
-                {
-                    //LOGD("Buffer ", j, " drawing spectrum");
-                    if (displayType == POWER_SPECTRUM)
-                    {
-                        needsRedraw = true;
-
-                        canvasPlot->updatePowerSpectrum (powerReader.operator*(), i);
-                    }
-                    else //Spectrogram
-                    {
-                        if (i == 0)
-                            canvasPlot->drawSpectrogram (powerReader.operator*());
-                    }
-                }
-            }
-        }
-    }
-
-    if (needsRedraw)
-        canvasPlot->plotPowerSpectrum();
+    // the render thread has already done the work, so this only hands it to the plots
+    for (auto* plot : canvasPlots)
+        plot->updateDisplay();
 }
 
 void SpectrumCanvas::setDisplayType (DisplayType type)
@@ -133,23 +176,59 @@ void SpectrumCanvas::setDisplayType (DisplayType type)
     if (CoreServices::getAcquisitionStatus())
     {
         stopCallbacks();
+        renderer->stop();
         displayType = type;
-        canvasPlot->setDisplayType (type);
+
+        for (auto* plot : canvasPlots)
+            plot->setDisplayType (type);
+        renderer->startThread();
         startCallbacks();
     }
     else
     {
         displayType = type;
-        canvasPlot->setDisplayType (type);
+
+        for (auto* plot : canvasPlots)
+            plot->setDisplayType (type);
     }
 
     resized();
 }
 
+/** CANVAS RENDERER - Prepares the plots' data on its own thread */
+
+CanvasRenderer::CanvasRenderer (OwnedArray<CanvasPlot>& plots_)
+    : Thread ("Spectrum Viewer renderer"), plots (plots_)
+{
+}
+
+CanvasRenderer::~CanvasRenderer()
+{
+    stop();
+}
+
+void CanvasRenderer::stop()
+{
+    signalThreadShouldExit();
+    notify();
+    stopThread (1000);
+}
+
+void CanvasRenderer::run()
+{
+    while (! threadShouldExit())
+    {
+        for (auto* plot : plots)
+            plot->render();
+
+        wait (RENDER_INTERVAL_MS);
+    }
+}
+
 /** CANVAS PLOT - Stores the plot along with it's legend*/
 
-CanvasPlot::CanvasPlot (SpectrumViewer* p)
-    : processor (p), displayType (POWER_SPECTRUM), freqStep (4), nFreqs (250), freqEnd (1000)
+CanvasPlot::CanvasPlot (SpectrumViewer* p, int viewIndex)
+    : processor (p), viewIndex (viewIndex), displayType (POWER_SPECTRUM), freqStep (4), nFreqs (250), freqStart (0), freqEnd (1000)
 {
     plt.title ("POWER SPECTRUM");
     XYRange range { 0, 1000, 0, 5 };
@@ -167,21 +246,15 @@ CanvasPlot::CanvasPlot (SpectrumViewer* p)
 
     activeChannels = processor->getActiveChans();
 
-    spectrogramImg = std::make_unique<Image> (Image::RGB, 1000, 1000, true);
-    setOpaque (true);
-
-    currPower.resize (MAX_CHANS);
-
-    for (int ch = 0; ch < MAX_CHANS; ch++)
+    for (int i = 0; i < SpectrumRenderer::SPECTROGRAM_LEVELS; i++)
     {
-        currPower[ch].clear();
-        lowPassFilters.add (new OwnedArray<Dsp::Filter>());
+        const float level = (float) i / (SpectrumRenderer::SPECTROGRAM_LEVELS - 1);
+        spectrogramColours[i] = Colour::fromHSV (level, 1.0f, level, 1.0f).getPixelARGB();
     }
 
-    for (int i = 0; i < nFreqs; i++)
-    {
-        xvalues.push_back (i * freqStep);
-    }
+    setOpaque (true);
+
+    updateFrequencies();
 }
 
 void CanvasPlot::resized()
@@ -197,51 +270,94 @@ void CanvasPlot::lookAndFeelChanged()
     plt.setAxisColour (findColour (ThemeColours::controlPanelText));
 
     chanColors[0] = findColour (ThemeColours::defaultText);
-    plt.plot (xvalues, currPower[0], chanColors[0], 1.0f);
+
+    // redraw the latest lines in the new colour
+    AtomicScopedReadPtr<SpectrumRenderer::Lines> lines (spectrumRenderer.getLines());
+
+    if (lines.isValid() && displayType == POWER_SPECTRUM && activeChannels.size() > 0)
+        plt.plot (xvalues, lines->values[0], chanColors[0], 1.0f);
 }
 
 void CanvasPlot::updateActiveChans()
 {
     activeChannels = processor->getActiveChans();
+    createFilters();
     clear();
     repaint();
 }
 
-void CanvasPlot::setFrequencyRange (int freqStart_, int freqEnd_, float freqStep_)
+void CanvasPlot::updateFrequencies()
 {
-    freqStep = freqStep_;
-    freqEnd = freqEnd_;
-    nFreqs = (int) (freqEnd_ - freqStart_) / freqStep_;
+    SpectrumView& view = processor->getView (viewIndex);
+    const std::vector<float>& frequencies = view.foi;
+
+    engine = &view.engine;
+
+    freqStep = view.freqStep;
+    freqStart = view.freqStart;
+    freqEnd = view.freqEnd;
+    nFreqs = (int) frequencies.size();
 
-    xvalues.clear();
-    for (int i = 0; i < nFreqs; i++)
+    // the plot has no log axis, so log-spaced frequencies are plotted as log10 (Hz)
+    logFrequency = processor->getMethod() == CumulativeTFR::CONSTANT_Q && nFreqs > 0;
+
+    // multitaper spectra are already averaged over tapers, so they are shown without further smoothing
+    smoothOverTime = processor->getMethod() != CumulativeTFR::MULTITAPER;
+
+    xvalues.resize (frequencies.size());
+
+    for (int n = 0; n < nFreqs; n++)
+    {
+        xvalues[n] = logFrequency ? std::log10 (frequencies[n]) : frequencies[n];
+    }
+
+    XYRange range { freqStart, freqEnd, 0, 5 };
+
+    if (logFrequency)
     {
-        xvalues.push_back (i * freqStep);
+        range.xmin = xvalues.front();
+        range.xmax = xvalues.back();
     }
 
-    XYRange range { (float) freqStart_, (float) freqEnd_, 0, 5 };
     plt.setRange (range);
+    plt.xlabel (logFrequency ? "Frequency (log10 Hz)" : "Frequency (Hz)");
+
+    // tell the ranges apart when several are shown side by side
+    rangeName = processor->getNumViews() > 1 ? " (" + String (roundToInt (freqStart)) + " - " + String (roundToInt (freqEnd)) + " Hz)" : String();
+    updateTitle();
+
+    createFilters();
+}
+
+void CanvasPlot::createFilters()
+{
+    numPairs = (int) processor->getCoherencePairs().size();
 
-    // Create a low pass filter for each frequency within each channel
-    for (int ch = 0; ch < MAX_CHANS; ch++)
+    // one row per frequency, so rows are not computed twice
+    const int spectrogramRows = jlimit (1, SPECTROGRAM_MAX_ROWS, nFreqs);
+
+    // constant-Q bins are already as wide as their spacing
+    spectrumRenderer.prepare (activeChannels.size(), numPairs, nFreqs, spectrogramRows, smoothOverTime, smoothOverTime && ! logFrequency);
+
+    createSpectrograms (spectrogramRows);
+}
+
+void CanvasPlot::createSpectrograms (int imageHeight)
+{
+    spectrogramTiles.resize (activeChannels.size());
+
+    for (auto& tile : spectrogramTiles)
     {
-        lowPassFilters[ch]->clear();
-        currPower[ch].clear();
-        for (int i = 0; i < nFreqs; i++)
+        if (! tile.image.isValid() || tile.image.getHeight() != imageHeight)
         {
-            lowPassFilters[ch]->add (new Dsp::SmoothedFilterDesign<Dsp::Butterworth::Design::LowPass // design type
-                                                                   <2>, // order
-                                                                   1, // number of channels (must be const)
-                                                                   Dsp::DirectFormII> (1));
-
-            Dsp::Params params;
-            params[0] = 50; // sample rate (Hz)
-            params[1] = 2; // order
-            params[2] = 1; // cut-off frequency
-            lowPassFilters[ch]->getLast()->setParams (params);
-
-            currPower[ch].push_back (0.0f);
+            tile.image = Image (Image::RGB, SPECTROGRAM_COLUMNS, imageHeight, true);
         }
+        else
+        {
+            tile.image.clear (tile.image.getBounds());
+        }
+
+        tile.column = 0;
     }
 }
 
@@ -249,6 +365,13 @@ void CanvasPlot::setDisplayType (DisplayType type)
 {
     displayType = type;
 
+    if (displayType == SPECTROGRAM)
+        spectrumRenderer.setMode (SpectrumRenderer::SPECTROGRAM_COLUMNS);
+    else if (displayType == COHERENCE)
+        spectrumRenderer.setMode (SpectrumRenderer::COHERENCE_LINES);
+    else
+        spectrumRenderer.setMode (SpectrumRenderer::POWER_LINES);
+
     if (displayType == SPECTROGRAM)
     {
         plt.setVisible (false);
@@ -260,131 +383,148 @@ void CanvasPlot::setDisplayType (DisplayType type)
         clearButton->setVisible (true);
     }
 
+    updateTitle();
+
     clear();
     repaint();
 }
 
-void CanvasPlot::plotPowerSpectrum()
+void CanvasPlot::updateTitle()
 {
-    plt.clear();
-
-    for (int i = 0; i < activeChannels.size(); i++)
+    if (displayType == COHERENCE)
     {
-        if (std::isgreater (maxPower, 0.0f))
-        {
-            XYRange pltRange;
-            plt.getRange (pltRange);
-
-            if (pltRange.ymax < maxPower || (pltRange.ymax - maxPower) > 5)
-            {
-                pltRange.ymax = maxPower;
-                plt.setRange (pltRange);
-            }
-        }
-
-        plt.plot (xvalues, currPower[i], chanColors[i], 1.0f);
+        plt.title ("COHERENCE" + rangeName);
+        plt.ylabel ("Coherence");
+    }
+    else
+    {
+        plt.title ("POWER SPECTRUM" + rangeName);
+        plt.ylabel ("Power");
     }
 }
 
-void CanvasPlot::updatePowerSpectrum (std::vector<float> powerData, int channelIndex)
+void CanvasPlot::render()
 {
-    // currPower[channelIndex].clear();
-    std::vector<float> powerBuffer;
+    if (resetRequested.exchange (false))
+        spectrumRenderer.reset();
+
+    if (engine == nullptr)
+        return;
+
+    bool hasNewLines = false;
+
+    for (int i = 0; i < engine->getNumChannels(); i++)
+        hasNewLines = spectrumRenderer.consumePower (i, *engine->getPower (i)) || hasNewLines;
+
+    for (int i = 0; i < engine->getNumPairs(); i++)
+        hasNewLines = spectrumRenderer.consumeCoherence (i, *engine->getCoherence (i)) || hasNewLines;
+
+    if (hasNewLines)
+        spectrumRenderer.publishLines();
+}
 
-    for (int n = 0; n < powerData.size(); n++)
+void CanvasPlot::updateDisplay()
+{
+    if (displayType == SPECTROGRAM)
     {
-        if (std::isfinite (powerData[n]))
+        bool hasNewColumns = false;
+
+        // colour the finished columns into the images, which only paint() reads
+        for (int i = 0; i < spectrogramTiles.size(); i++)
         {
-            // Apply low pass filter for that frequency
-            float* pData = &powerData[n];
-            lowPassFilters[channelIndex]->getUnchecked (n)->process (1, &pData);
+            SpectrogramTile& tile = spectrogramTiles[i];
+            FrameQueue<uint8>& columns = spectrumRenderer.getColumns (i);
+
+            const int imageWidth = tile.image.getWidth();
+            const int imageHeight = tile.image.getHeight();
 
-            if (std::isgreaterequal (*pData, 1.0f))
+            while (const uint8* column = columns.getReadPointer())
             {
-                float logP = log (*pData);
+                // the newest column moves one to the left instead of the whole image moving right
+                tile.column = (tile.column + imageWidth - 1) % imageWidth;
 
-                if (logP > maxPower)
-                    maxPower = logP;
+                Image::BitmapData pixels (tile.image, tile.column, 0, 1, imageHeight, Image::BitmapData::writeOnly);
+                jassert (pixels.pixelFormat == Image::RGB);
 
-                powerBuffer.push_back (logP);
-            }
-            else
-            {
-                powerBuffer.push_back (currPower[channelIndex][n]);
+                for (int y = 0; y < imageHeight; y++)
+                    reinterpret_cast<PixelRGB*> (pixels.getPixelPointer (0, y))->set (spectrogramColours[column[y]]);
+
+                columns.finishedRead();
+                hasNewColumns = true;
             }
         }
+
+        // once for all channels' new columns
+        if (hasNewColumns)
+            repaint();
+    }
+    else if (spectrumRenderer.getLines().hasUpdate())
+    {
+        AtomicScopedReadPtr<SpectrumRenderer::Lines> lines (spectrumRenderer.getLines());
+
+        if (! lines.isValid())
+            return;
+
+        if (displayType == COHERENCE)
+            plotCoherence (*lines);
         else
-        {
-            powerBuffer.push_back (currPower[channelIndex][n]);
-        }
+            plotPowerSpectrum (*lines);
     }
+}
 
-    if (true)
-    {
-        float window[] = { 0.1111, 0.1111, 0.1111, 0.1111, 0.1111, 0.1111, 0.1111, 0.1111, 0.1111 };
+void CanvasPlot::plotPowerSpectrum (const SpectrumRenderer::Lines& lines)
+{
+    // only called for new lines, but InteractivePlot copies each one it is given
+    plt.clear();
 
-        // apply smoothing
-        for (int n = 0; n < powerBuffer.size(); n++)
+    for (int i = 0; i < activeChannels.size(); i++)
+    {
+        if (std::isgreater (lines.maxPower, 0.0f))
         {
-            float value = 0;
+            XYRange pltRange;
+            plt.getRange (pltRange);
 
-            for (int offset = -4; offset < 5; offset++)
+            if (pltRange.ymax < lines.maxPower || (pltRange.ymax - lines.maxPower) > 5)
             {
-                int i = n + offset;
-
-                if (i < 0)
-                {
-                    i = 0;
-                }
-                else if (i >= powerBuffer.size())
-                {
-                    i = powerBuffer.size() - 1;
-                }
-
-                value += (powerBuffer[i] * window[offset + 4]);
+                pltRange.ymax = lines.maxPower;
+                plt.setRange (pltRange);
             }
-
-            currPower.at (channelIndex).at (n) = value;
         }
+
+        plt.plot (xvalues, lines.values[i], getChannelColour (i), 1.0f);
     }
 }
 
-void CanvasPlot::drawSpectrogram (std::vector<float> chanData)
+void CanvasPlot::plotCoherence (const SpectrumRenderer::Lines& lines)
 {
-    auto imageWidth = spectrogramImg->getWidth() - 1;
-    auto imageHeight = spectrogramImg->getHeight();
-
-    // first, shuffle our image rightwards by 1 pixel..
-    spectrogramImg->moveImageSection (1, 0, 0, 0, imageWidth, imageHeight);
+    plt.clear();
 
-    // find the range of values produced, so we can scale our rendering to
-    // show up the detail clearly
-    auto powerRange = juce::FloatVectorOperations::findMinAndMax (chanData.data(), chanData.size());
+    XYRange pltRange;
+    plt.getRange (pltRange);
 
-    for (auto y = 0; y < imageHeight - 1; ++y)
+    if (pltRange.ymin != 0 || pltRange.ymax != 1)
     {
-        auto skewedProportionY = 1.0f - (float) y / (float) imageHeight;
-        auto dataIndex = (size_t) jlimit (0, (int) (chanData.size() - 1), (int) (skewedProportionY * (chanData.size() - 1)));
-
-        float logPower = chanData[dataIndex] > 0.0f ? std::log10 (1.0f + chanData[dataIndex]) : 0.0f;
-        float logMax = powerRange.getEnd() > 0.0f ? std::log10 (1.0f + powerRange.getEnd()) : 0.0f;
-        float logMin = powerRange.getStart() > 0.0f ? std::log10 (1.0f + powerRange.getStart()) : 0.0f;
-
-        auto level = juce::jmap (logPower, logMin, juce::jmax (logMax, 1e-5f), 0.0f, 1.0f);
-
-        spectrogramImg->setPixelAt (0, y, juce::Colour::fromHSV (level, 1.0f, level, 1.0f));
+        pltRange.ymin = 0;
+        pltRange.ymax = 1;
+        plt.setRange (pltRange);
     }
 
-    repaint();
+    for (int i = 0; i < numPairs; i++)
+    {
+        plt.plot (xvalues, lines.values[i], getChannelColour (i), 1.0f);
+    }
 }
 
 void CanvasPlot::paint (Graphics& g)
 {
     g.fillAll (findColour (ThemeColours::componentParentBackground));
 
-    if (displayType == POWER_SPECTRUM)
+    if (displayType != SPECTROGRAM)
     {
-        if (activeChannels.size() == 0)
+        const int numEntries = displayType == COHERENCE ? numPairs : activeChannels.size();
+
+        // side by side ranges share the legend of the last one
+        if (numEntries == 0 || legendWidth == 0)
             return;
 
         int left = getWidth() - legendWidth - 10;
@@ -392,16 +532,16 @@ void CanvasPlot::paint (Graphics& g)
 
         g.setFont (FontOptions ("Inter", "Semi Bold", 16.0f));
 
-        for (int i = 0; i < activeChannels.size(); i++)
+        for (int i = 0; i < numEntries; i++)
         {
             top = (i + 1) * rowHeight + 10;
 
-            g.setColour (chanColors.at (i));
+            g.setColour (getChannelColour (i));
             g.fillRect (left, top + 10, 30, 30);
 
             g.setColour (findColour (ThemeColours::controlPanelText));
-            String chan = processor->getChanName (activeChannels[i]);
-            g.drawFittedText (chan, left + 45, top + 10, (legendWidth - 20) / 2, 30, Justification::centredLeft, 1);
+            String chan = displayType == COHERENCE ? processor->getPairName (i) : processor->getChanName (activeChannels[i]);
+            g.drawFittedText (chan, left + 45, top + 10, legendWidth - 55, 30, Justification::centredLeft, 1);
 
             g.setColour (findColour (ThemeColours::defaultFill));
             g.drawRect (left, top + 10, 30, 30, 2);
@@ -409,50 +549,129 @@ void CanvasPlot::paint (Graphics& g)
     }
     else
     {
-        g.setColour (findColour (ThemeColours::controlPanelText));
+        const int numTiles = (int) spectrogramTiles.size();
 
-        int w = 50;
-        int h = getHeight();
+        if (numTiles == 0)
+            return;
 
         int padding = 10;
+        int gap = 6;
 
-        g.drawLine (w - 3, padding, w - 3, h - padding, 2.0);
-
-        int ticklabelWidth = 60;
-        int tickLabelHeight = 20;
+        const float tileHeight = (float) (getHeight() - padding * 2 - gap * (numTiles - 1)) / numTiles;
 
-        g.setFont (FontOptions ("Inter", "Regular", 12.0f));
+        // nearest-neighbour scaling keeps dozens of tiles cheap to draw
+        g.setImageResamplingQuality (Graphics::lowResamplingQuality);
 
-        for (int k = 0; k <= 10; k++)
+        for (int i = 0; i < numTiles; i++)
         {
-            float ytickloc = padding + ((k) * (h - padding * 2) / 10);
+            const int top = padding + roundToInt (i * (tileHeight + gap));
+            const int bottom = padding + roundToInt (i * (tileHeight + gap) + tileHeight);
+
+            drawSpectrogramTile (g, i, top, bottom);
+        }
+    }
+}
+
+void CanvasPlot::drawSpectrogramTile (Graphics& g, int channelIndex, int top, int bottom)
+{
+    const SpectrogramTile& tile = spectrogramTiles[channelIndex];
+
+    g.setColour (findColour (ThemeColours::controlPanelText));
+
+    int w = 50;
 
-            ytickloc = h - ytickloc;
+    g.drawLine (w - 3, top, w - 3, bottom, 2.0);
 
-            g.drawLine (w - 13, ytickloc, w - 3, ytickloc, 2.0);
+    int tickLabelHeight = 20;
 
-            String yTick;
+    g.setFont (FontOptions ("Inter", "Regular", 12.0f));
 
-            if (k != 0)
-                yTick = String ((freqEnd * k) / 10);
-            else
-                yTick = String (0);
+    // up to 10 ticks, fewer as the tiles get smaller
+    const int numTicks = jlimit (1, 10, (bottom - top) / 40);
 
-            g.drawText (yTick,
-                        0,
-                        ytickloc - tickLabelHeight / 2,
-                        w - 15,
-                        tickLabelHeight,
-                        Justification::right,
-                        false);
+    for (int k = 0; k <= numTicks; k++)
+    {
+        float ytickloc = bottom - (float) k * (bottom - top) / numTicks;
+
+        g.drawLine (w - 13, ytickloc, w - 3, ytickloc, 2.0);
+
+        // the top label would overlap the bottom label of the tile above
+        if (k == numTicks && channelIndex > 0)
+            continue;
+
+        String yTick;
+
+        if (logFrequency)
+        {
+            // rows are log-spaced, so the ticks are too
+            const float tickFreq = std::pow (10.0f, xvalues.front() + (xvalues.back() - xvalues.front()) * k / numTicks);
+
+            yTick = tickFreq >= 10 ? String (roundToInt (tickFreq)) : String (tickFreq, 1);
+        }
+        else
+        {
+            // whole numbers of Hz, unless zoomed into a narrow band
+            const float tickFreq = freqStart + (freqEnd - freqStart) * k / numTicks;
+
+            yTick = (freqEnd - freqStart >= 10) ? String (roundToInt (tickFreq)) : String (tickFreq, 2);
         }
 
-        auto imgBounds = getLocalBounds();
-        imgBounds.setLeft (60);
-        imgBounds.setRight (getWidth() - 10);
-        imgBounds.setBottom (getHeight() - 10);
-        imgBounds.setTop (10);
-        g.drawImage (*spectrogramImg, imgBounds.toFloat());
+        g.drawText (yTick,
+                    0,
+                    ytickloc - tickLabelHeight / 2,
+                    w - 15,
+                    tickLabelHeight,
+                    Justification::right,
+                    false);
+    }
+
+    auto imgBounds = getLocalBounds();
+    imgBounds.setLeft (60);
+    imgBounds.setRight (getWidth() - 10);
+    imgBounds.setBottom (bottom);
+    imgBounds.setTop (top);
+
+    // the ring of columns is drawn in two slices: from the newest column to the
+    // right edge of the image, then from its left edge up to the newest column
+    const int imageWidth = tile.image.getWidth();
+    const int imageHeight = tile.image.getHeight();
+    const int newerColumns = imageWidth - tile.column;
+    const int split = imgBounds.getX() + roundToInt ((float) imgBounds.getWidth() * newerColumns / imageWidth);
+
+    g.drawImage (tile.image,
+                 imgBounds.getX(),
+                 imgBounds.getY(),
+                 split - imgBounds.getX(),
+                 imgBounds.getHeight(),
+                 tile.column,
+                 0,
+                 newerColumns,
+                 imageHeight);
+
+    if (tile.column > 0)
+    {
+        g.drawImage (tile.image,
+                     split,
+                     imgBounds.getY(),
+                     imgBounds.getRight() - split,
+                     imgBounds.getHeight(),
+                     0,
+                     0,
+                     tile.column,
+                     imageHeight);
+    }
+
+    // name the channel when there is more than one
+    if (spectrogramTiles.size() > 1)
+    {
+        g.setColour (getChannelColour (channelIndex));
+        g.drawText (processor->getChanName (activeChannels[channelIndex]),
+                    imgBounds.getX() + 5,
+                    imgBounds.getY() + 2,
+                    jmin (150, imgBounds.getWidth() - 10),
+                    14,
+                    Justification::centredLeft,
+                    true);
     }
 }
 
@@ -466,19 +685,17 @@ void CanvasPlot::buttonClicked (Button* button)
 
 void CanvasPlot::clear()
 {
-    for (int ch = 0; ch < MAX_CHANS; ch++)
-    {
-        currPower[ch].clear();
+    // the filters and spectra belong to the render thread
+    resetRequested = true;
 
-        for (int i = 0; i < nFreqs; i++)
-        {
-            lowPassFilters[ch]->getUnchecked (i)->reset();
-            currPower[ch].push_back (0.0f);
-        }
-    }
+    // discard what was prepared before the clear
+    spectrumRenderer.discardOutput();
 
-    maxPower = 0.0f;
+    for (auto& tile : spectrogramTiles)
+    {
+        tile.image.clear (tile.image.getBounds());
+        tile.column = 0;
+    }
 
-    spectrogramImg->clear (spectrogramImg->getBounds());
     plt.clear();
 }
\ No newline at end of file
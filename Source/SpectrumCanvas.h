@@ -26,19 +26,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <VisualizerWindowHeaders.h>
 
-#include "AtomicSynchronizer.h"
+#include "SpectrumRenderer.h"
 #include "SpectrumViewer.h"
 
-#include <DspLib.h>
-
 class SpectrumCanvas;
 
 // Component for housing power spectrum & spectrograph plots
 class CanvasPlot : public Component, public Button::Listener
 {
 public:
-    /** Constructor */
-    CanvasPlot (SpectrumViewer* p);
+    /** Constructor, for one of the processor's views */
+    CanvasPlot (SpectrumViewer* p, int viewIndex);
 
     /** Destructor */
     ~CanvasPlot() {}
@@ -54,23 +52,34 @@ public:
 
     void updateActiveChans();
 
-    void setFrequencyRange (int freqStart, int freqEnd, float freqStep);
-
-    void updatePowerSpectrum (std::vector<float> powerData, int channelIndex);
+    /** Gets the displayed frequencies of the view from the processor; they need not start at 0,
+        and constant-Q frequencies are shown on a log axis */
+    void updateFrequencies();
 
-    void plotPowerSpectrum();
+    /** Consumes the view's new frames and prepares them for display (render thread).
+        Must not run while the settings are being changed. */
+    void render();
 
-    void drawSpectrogram (std::vector<float> powerData);
+    /** Shows the data prepared by render() since the last call (message thread). Reading the lines
+        and copying spectrogram columns into the images does not allocate, but InteractivePlot
+        copies every line it is given, so each new power or coherence frame still allocates here. */
+    void updateDisplay();
 
-    /** Sets the display type for the canvas (Power Spectrum or Spectrogram)*/
+    /** Sets the display type for the canvas (Power Spectrum, Spectrogram or Coherence)*/
     void setDisplayType (DisplayType type);
 
     /** Called when a button is clicked */
     void buttonClicked (Button* button) override;
 
-    /** Clears the plot */
+    /** Clears the plot; the render thread clears its own state before its next frame */
     void clear();
 
+    /** Returns the height needed to show every channel's spectrogram */
+    int getSpectrogramHeight() const { return (int) spectrogramTiles.size() * MIN_TILE_HEIGHT + 20; }
+
+    /** Returns the height needed to show the legend for all channels or pairs */
+    int getLegendHeight() const { return (jmax (activeChannels.size(), numPairs) + 1) * rowHeight + 20; }
+
     int legendWidth = 150;
 
     DisplayType displayType;
@@ -85,15 +94,50 @@ private:
                                        Colour (242, 66, 53),
                                        Colour (204, 121, 167) };
 
+    /** Returns the colour of a channel, cycling through chanColors */
+    Colour getChannelColour (int index) const { return chanColors[index % chanColors.size()]; }
+
+    /** Sets the title and y label for the display type and range */
+    void updateTitle();
+
+    /** Plots the power spectrum of every channel (message thread) */
+    void plotPowerSpectrum (const SpectrumRenderer::Lines& lines);
+
+    /** Plots the coherence of every channel pair (message thread) */
+    void plotCoherence (const SpectrumRenderer::Lines& lines);
+
+    /** Prepares the renderer and spectrograms for each frequency within each active channel,
+        and resets the coherence of each pair */
+    void createFilters();
+
+    /** Creates a spectrogram image of the given height for each active channel, reusing those that fit */
+    void createSpectrograms (int imageHeight);
+
+    /** Draws one channel's spectrogram and its frequency axis between two heights */
+    void drawSpectrogramTile (Graphics& g, int channelIndex, int top, int bottom);
+
     std::unique_ptr<UtilityButton> clearButton;
 
     SpectrumViewer* processor;
 
+    /** Index of the processor's view this plot shows */
+    const int viewIndex;
+
+    /** Engine of that view, whose frames the render thread consumes */
+    SpectrumEngine* engine = nullptr;
+
+    /** Range appended to the title when several ranges are shown */
+    String rangeName;
+
     int rowHeight = 50;
 
-    float maxPower = 0.0f;
+    /** Turns the frames into lines and spectrogram columns on the render thread */
+    SpectrumRenderer spectrumRenderer;
+
+    /** Set by clear() for the render thread */
+    std::atomic<bool> resetRequested { false };
 
-    std::vector<std::vector<float>> currPower; // channels x freqs
+    // Message thread; the settings below only change while the render thread is stopped
 
     std::vector<float> xvalues;
 
@@ -101,18 +145,79 @@ private:
 
     float freqStep;
     int nFreqs;
-    int freqEnd;
+    float freqStart;
+    float freqEnd;
+
+    /** Number of coherence pairs shown */
+    int numPairs = 0;
+
+    /** Whether the frequencies are log-spaced, with xvalues holding their log10 */
+    bool logFrequency = false;
+
+    /** Whether the power is low-pass filtered over time; multitaper spectra are already averaged */
+    bool smoothOverTime = true;
 
     Array<int> activeChannels;
 
-    /** Image to draw*/
-    std::unique_ptr<Image> spectrogramImg;
+    /** Spectrogram of one channel, drawn into a ring of image columns */
+    struct SpectrogramTile
+    {
+        Image image;
+
+        /** Column holding the newest frame; older frames follow it
+            to the right, wrapping around to column 0 (message thread) */
+        int column = 0;
+    };
+
+    /** One spectrogram per active channel, stacked from top to bottom */
+    std::vector<SpectrogramTile> spectrogramTiles;
+
+    /** Number of frames each spectrogram shows */
+    static const int SPECTROGRAM_COLUMNS = 1000;
 
-    OwnedArray<OwnedArray<Dsp::Filter>> lowPassFilters;
+    /** Most rows of a spectrogram image; below this, each frequency gets one row */
+    static const int SPECTROGRAM_MAX_ROWS = 1000;
+
+    /** Smallest height of a spectrogram on screen, beyond which the canvas scrolls */
+    static const int MIN_TILE_HEIGHT = 30;
+
+    /** Colour of each level of a spectrogram column, from the lowest power to the highest */
+    PixelARGB spectrogramColours[SpectrumRenderer::SPECTROGRAM_LEVELS];
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CanvasPlot);
 };
 
+/**
+
+	Consumes the frames of every plot on its own thread, so filtering,
+	smoothing and colouring neither wait for nor hold up the message thread.
+	Runs while the canvas is animating, and is stopped while settings change.
+
+*/
+class CanvasRenderer : public Thread
+{
+public:
+    /** Constructor */
+    CanvasRenderer (OwnedArray<CanvasPlot>& plots);
+
+    /** Destructor, stops the thread */
+    ~CanvasRenderer();
+
+    /** Stops the thread, waiting for the current pass over the plots to finish */
+    void stop();
+
+private:
+    /** Renders every plot, then sleeps for RENDER_INTERVAL_MS */
+    void run() override;
+
+    /** Time between passes; frames arrive every 20 ms */
+    static const int RENDER_INTERVAL_MS = 5;
+
+    OwnedArray<CanvasPlot>& plots;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CanvasRenderer);
+};
+
 /** 
 
 	Draws the real-time power spectrum
@@ -148,16 +253,25 @@ public:
     /** Updates component boundaries */
     void resized() override;
 
-    /** Sets the display type for the canvas (Power Spectrum or Spectrogram)*/
+    /** Sets the display type for the canvas (Power Spectrum, Spectrogram or Coherence)*/
     void setDisplayType (DisplayType type);
 
-    CanvasPlot* getPlotPtr() { return canvasPlot.get(); };
-
 private:
+    /** Creates or removes plots so there is one per view of the processor */
+    void updatePlots();
+
     SpectrumViewer* processor;
 
+    /** Holds the plots side by side inside the viewport */
+    std::unique_ptr<Component> plotHolder;
+
+    /** One plot per frequency range */
+    OwnedArray<CanvasPlot> canvasPlots;
+
+    /** Prepares the plots' data off the message thread; destroyed before them */
+    std::unique_ptr<CanvasRenderer> renderer;
+
     std::unique_ptr<Viewport> viewport;
-    std::unique_ptr<CanvasPlot> canvasPlot;
     juce::Rectangle<int> canvasBounds;
 
     DisplayType displayType;
@@ -0,0 +1,221 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "SpectrumEngine.h"
+#include "SpectralKernels.h"
+
+#include <cmath>
+
+void SpectrumEngine::setNumChannels (int numChannels_)
+{
+    if (numChannels != numChannels_)
+    {
+        numChannels = numChannels_;
+        channelsChanged = true;
+    }
+}
+
+void SpectrumEngine::setBufferSize (int bufferSize_, int stepSize_)
+{
+    jassert (stepSize_ > 0);
+
+    if (bufferSize != bufferSize_ || stepSize != stepSize_)
+    {
+        bufferSize = bufferSize_;
+        stepSize = stepSize_;
+        bufferSizeChanged = true;
+    }
+}
+
+void SpectrumEngine::setNumFreqs (int nFreqs_)
+{
+    if (nFreqs != nFreqs_)
+    {
+        nFreqs = nFreqs_;
+        numFreqsChanged = true;
+    }
+}
+
+void SpectrumEngine::setNumPairs (int numPairs_)
+{
+    if (numPairs != numPairs_)
+    {
+        numPairs = numPairs_;
+        pairsChanged = true;
+    }
+}
+
+void SpectrumEngine::setWindowed (bool shouldApplyWindow)
+{
+    if (windowed != shouldApplyWindow)
+    {
+        windowed = shouldApplyWindow;
+        windowChanged = true;
+    }
+}
+
+void SpectrumEngine::resize()
+{
+    if (bufferSizeChanged)
+    {
+        // one window plus one more window of slack for the FFT thread to fall behind
+        ringSize = 2 * bufferSize + MAX_BLOCK_SIZE;
+    }
+
+    if (bufferSizeChanged || windowChanged)
+    {
+        window.allocate (bufferSize, false);
+
+        const float N = float (bufferSize);
+        const float PI = 3.1415926535;
+
+        for (int n = 0; n < bufferSize; n++)
+        {
+            window[n] = windowed ? 0.54 - 0.46 * cos (2 * PI * n / N) : 1.0f;
+        }
+    }
+
+    if (bufferSizeChanged || channelsChanged)
+    {
+        LOGD ("Creating ", numChannels, " sample rings of length ", ringSize, " for windows of length ", bufferSize);
+
+        samples.allocate ((size_t) numChannels * ringSize, true);
+    }
+
+    if (numFreqsChanged || channelsChanged)
+    {
+        power.clear();
+
+        LOGD ("Creating ", NUM_POWER_BUFFERS, " power buffers of length ", nFreqs, " for ", numChannels, " channels");
+
+        for (int i = 0; i < numChannels; i++)
+        {
+            power.add (new FrameFifo (NUM_POWER_BUFFERS, nFreqs));
+        }
+    }
+
+    if (numFreqsChanged || pairsChanged)
+    {
+        coherence.clear();
+
+        for (int i = 0; i < numPairs; i++)
+        {
+            coherence.add (new FrameFifo (NUM_POWER_BUFFERS, nFreqs));
+        }
+    }
+
+    bufferSizeChanged = false;
+    windowChanged = false;
+    channelsChanged = false;
+    numFreqsChanged = false;
+    pairsChanged = false;
+
+    LOGD ("Spectrum engine uses ", getBytesPerChannel() / 1024, " kB per channel");
+}
+
+void SpectrumEngine::reset()
+{
+    for (auto* p : power)
+        p->reset();
+
+    for (auto* c : coherence)
+        c->reset();
+
+    samples.clear ((size_t) numChannels * ringSize);
+    totalSamplesWritten = 0;
+    nextWindowEnd = bufferSize;
+}
+
+void SpectrumEngine::write (int channel, const float* data, int numSamples)
+{
+    const int64 total = totalSamplesWritten.load (std::memory_order_relaxed);
+    float* ring = samples + (size_t) channel * ringSize;
+
+    // only the tail of an oversized block can be kept
+    const int skipped = jmax (0, numSamples - ringSize);
+    const int toCopy = numSamples - skipped;
+    const int writePos = int ((total + skipped) % ringSize);
+    const int firstPart = jmin (toCopy, ringSize - writePos);
+
+    FloatVectorOperations::copy (ring + writePos, data + skipped, firstPart);
+    FloatVectorOperations::copy (ring, data + skipped + firstPart, toCopy - firstPart);
+}
+
+bool SpectrumEngine::finishBlock (int numSamples)
+{
+    const int64 total = totalSamplesWritten.load (std::memory_order_relaxed);
+
+    totalSamplesWritten.store (total + numSamples, std::memory_order_release);
+
+    return getNumWindowsEnded (total + numSamples) > getNumWindowsEnded (total);
+}
+
+int64 SpectrumEngine::getNumWindowsEnded (int64 samplesWritten) const
+{
+    if (samplesWritten < bufferSize)
+        return 0;
+
+    return (samplesWritten - bufferSize) / stepSize + 1;
+}
+
+bool SpectrumEngine::readWindow (int channel, int64 windowEnd, SpectrumSample* dest)
+{
+    const int64 windowStart = windowEnd - bufferSize;
+    const float* ring = samples + (size_t) channel * ringSize;
+    const int readPos = int (windowStart % ringSize);
+    const int firstPart = jmin (bufferSize, ringSize - readPos);
+
+    SpectralKernels::applyWindow (ring + readPos, window, dest, firstPart);
+    SpectralKernels::applyWindow (ring, window + firstPart, dest + firstPart, bufferSize - firstPart);
+
+    std::atomic_thread_fence (std::memory_order_acquire);
+
+    const int64 written = totalSamplesWritten.load (std::memory_order_relaxed);
+
+    return written + MAX_BLOCK_SIZE <= windowStart + ringSize;
+}
+
+bool SpectrumEngine::readSamples (int channel, int64 start, int numSamples, SpectrumSample* dest)
+{
+    const float* ring = samples + (size_t) channel * ringSize;
+    const int readPos = int (start % ringSize);
+    const int firstPart = jmin (numSamples, ringSize - readPos);
+
+    std::copy (ring + readPos, ring + readPos + firstPart, dest);
+    std::copy (ring, ring + numSamples - firstPart, dest + firstPart);
+
+    std::atomic_thread_fence (std::memory_order_acquire);
+
+    const int64 written = totalSamplesWritten.load (std::memory_order_relaxed);
+
+    return written + MAX_BLOCK_SIZE <= start + ringSize;
+}
+
+size_t SpectrumEngine::getBytesPerChannel() const
+{
+    const size_t ringBytes = (size_t) ringSize * sizeof (float);
+    const size_t powerBytes = (size_t) (NUM_POWER_BUFFERS + 1) * nFreqs * sizeof (float);
+    const size_t tfrBytes = (size_t) (bufferSize + 2) * sizeof (SpectrumSample) + (size_t) nFreqs * sizeof (SpectrumSample);
+
+    return ringBytes + powerBytes + tfrBytes;
+}
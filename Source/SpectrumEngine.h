@@ -0,0 +1,172 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SPECTRUM_ENGINE_H_INCLUDED
+#define SPECTRUM_ENGINE_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include "CumulativeTFR.h"
+#include "FrameFifo.h"
+
+#include <atomic>
+#include <vector>
+
+/*
+	Holds incoming samples and outgoing powers for every selected channel,
+	and outgoing coherence for every selected channel pair.
+
+	Storage is channel-major and only allocated for the channels that are
+	actually selected. Samples arrive already decimated (see DecimatorCascade),
+	so N counts decimated samples. Each frequency range shown has its own engine.
+	The FFT has fftLen points: N for the sliding DFT and Welch methods, otherwise
+	N x interpRatio (the padding) rounded up to a length whose only prime factors
+	are 2, 3, 5 and 7 (see FFTWPlanner::getFastLength). With F displayed
+	frequencies, each channel costs:
+
+	  - sample ring:   (2 N + MAX_BLOCK_SIZE) x 4 bytes
+	  - power frames:  (NUM_POWER_BUFFERS + 1) x F x 4 bytes
+	  - TFR FFT row:   (fftLen + 2) x 8 bytes (4 in single precision), rounded up to 64 bytes,
+	                   one per taper in the multitaper method
+	  - TFR averages:  F x 8 bytes (4 in single precision)
+	  - coefficients:  2 F x 8 bytes (4 in single precision), wavelet, constant-Q and sliding DFT methods
+
+	plus the decimator's history (4 bytes per filter tap, see DecimatorCascade)
+	and what the method keeps on top: wavelet tails, Welch segment spectra or
+	sliding DFT state. The README's resource table gives the totals. Each step
+	runs one fftLen-point real FFT (roughly 2.5 fftLen log2 fftLen flops),
+	executed in batches of up to CumulativeTFR::MAX_CHANNELS_PER_BATCH channels, one or more per FFT thread.
+*/
+class SpectrumEngine
+{
+public:
+    /** Extra ring capacity reserved for blocks written while a window is being read */
+    static const int MAX_BLOCK_SIZE = 8192;
+
+    /** Number of power frames per channel that can be waiting for the canvas */
+    static const int NUM_POWER_BUFFERS = 8;
+
+    /** Constructor */
+    SpectrumEngine() {}
+
+    /** Destructor */
+    ~SpectrumEngine() {}
+
+    /** Changes the number of channels */
+    void setNumChannels (int numChannels);
+
+    /** Changes buffer size*/
+    void setBufferSize (int bufferSize, int stepSize);
+
+    /** Changes num freqs */
+    void setNumFreqs (int nFreqs);
+
+    /** Changes the number of channel pairs with coherence frames */
+    void setNumPairs (int numPairs);
+
+    /** Chooses whether readWindow applies the Hamming window (wavelets and tapers need the raw samples) */
+    void setWindowed (bool shouldApplyWindow);
+
+    /** Reallocates all buffers that changed size */
+    void resize();
+
+    /** Resets all shared objects and indices */
+    void reset();
+
+    /** Copies a block of samples into a channel's ring without publishing it (audio thread) */
+    void write (int channel, const float* data, int numSamples);
+
+    /** Publishes the samples written for all channels since the last call (audio thread).
+        Returns true if at least one new window was completed. */
+    bool finishBlock (int numSamples);
+
+    /** Copies the window of a channel ending at windowEnd into an FFT input row
+        and applies the Hamming window, if enabled. Returns false if the audio thread overwrote
+        part of the window while it was being copied. */
+    bool readWindow (int channel, int64 windowEnd, SpectrumSample* dest);
+
+    /** Copies numSamples samples of a channel, starting at sample count start, without windowing.
+        Returns false if the audio thread overwrote some of them while they were being copied. */
+    bool readSamples (int channel, int64 start, int numSamples, SpectrumSample* dest);
+
+    /** Returns the total number of samples published for each channel */
+    int64 getTotalSamplesWritten() const { return totalSamplesWritten.load (std::memory_order_acquire); }
+
+    /** Returns the queue of outgoing power frames for a channel */
+    FrameFifo* getPower (int channel) { return power[channel]; }
+
+    /** Returns the queue of outgoing coherence frames for a channel pair */
+    FrameFifo* getCoherence (int pair) { return coherence[pair]; }
+
+    /** Returns the approximate memory used by each channel, in bytes, counting the
+        FFT row as N + 2 samples since the engine does not know the padding */
+    size_t getBytesPerChannel() const;
+
+    int getNumChannels() const { return numChannels; }
+    int getBufferSize() const { return bufferSize; }
+    int getStepSize() const { return stepSize; }
+    int getNumFreqs() const { return nFreqs; }
+    int getNumPairs() const { return numPairs; }
+
+    /** Sample count at which the next window ends (FFT thread only) */
+    int64 nextWindowEnd = 0;
+
+private:
+    /** Returns the number of windows that have ended once a given number of samples was written */
+    int64 getNumWindowsEnded (int64 samplesWritten) const;
+
+    /** Rings of incoming samples, channel-major */
+    HeapBlock<float> samples;
+
+    /** Outgoing power frames for each channel, in the order they were computed */
+    OwnedArray<FrameFifo> power;
+
+    /** Outgoing coherence frames for each channel pair */
+    OwnedArray<FrameFifo> coherence;
+
+    /** Hamming window to apply to buffer */
+    HeapBlock<float> window;
+
+    int numChannels = 0;
+    int bufferSize = 0;
+    int stepSize = 0;
+    int nFreqs = 0;
+    int numPairs = 0;
+    bool windowed = true;
+
+    /** Number of samples held by each ring */
+    int ringSize = 0;
+
+    /** Keep track of total samples written (published by the audio thread) */
+    std::atomic<int64> totalSamplesWritten { 0 };
+
+    bool bufferSizeChanged = true;
+    bool windowChanged = true;
+    bool channelsChanged = true;
+    bool numFreqsChanged = true;
+    bool pairsChanged = true;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrumEngine);
+};
+
+#endif // SPECTRUM_ENGINE_H_INCLUDED
@@ -0,0 +1,281 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "SpectrumRenderer.h"
+#include "SpectralKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+void SpectrumRenderer::prepare (int numChannels, int numPairs, int numFreqs, int spectrogramRows, bool smoothOverTime_, bool smoothAcrossFrequencies_)
+{
+    smoothOverTime = smoothOverTime_;
+    smoothAcrossFrequencies = smoothAcrossFrequencies_;
+
+    currPower.resize (numChannels);
+    frameData.resize (numChannels);
+
+    // frame storage is sized here, so rendering never allocates
+    powerBuffer.resize (numFreqs);
+    isValid.resize (numFreqs);
+
+    for (int ch = 0; ch < numChannels; ch++)
+    {
+        currPower[ch].resize (numFreqs);
+        frameData[ch].resize (numFreqs);
+        std::fill (currPower[ch].begin(), currPower[ch].end(), 0.0f);
+    }
+
+    // Low pass filter state for each frequency within each channel
+    smoother.prepare (numChannels, numFreqs);
+
+    currCoherence.resize (numPairs);
+
+    for (auto& coherence : currCoherence)
+    {
+        coherence.resize (numFreqs);
+        std::fill (coherence.begin(), coherence.end(), 0.0f);
+    }
+
+    // room for every channel's or pair's line in each of the shared copies
+    const size_t numLines = jmax (currPower.size(), currCoherence.size());
+
+    lines.reset();
+    lines.map ([numLines, numFreqs] (Lines& l)
+               {
+                   l.values.resize (numLines);
+
+                   for (auto& line : l.values)
+                       line.resize (numFreqs);
+               });
+
+    columnScales.assign (numChannels, ColumnScale());
+    columns.resize (numChannels);
+
+    for (auto& queue : columns)
+    {
+        if (queue == nullptr || queue->getFrameSize() != spectrogramRows)
+            queue = std::make_unique<FrameQueue<uint8>> (COLUMN_QUEUE_SIZE, spectrogramRows);
+        else
+            queue->reset();
+    }
+
+    maxPower = 0.0f;
+}
+
+void SpectrumRenderer::reset()
+{
+    for (auto& power : currPower)
+        std::fill (power.begin(), power.end(), 0.0f);
+
+    for (auto& coherence : currCoherence)
+        std::fill (coherence.begin(), coherence.end(), 0.0f);
+
+    smoother.reset();
+    maxPower = 0.0f;
+
+    for (auto& scale : columnScales)
+        scale.hasFrame = false;
+}
+
+bool SpectrumRenderer::consumePower (int channel, FrameFifo& frames)
+{
+    bool lineChanged = false;
+
+    // frames arrive in the order they were computed, and are read straight
+    // out of the FIFO, so nothing is allocated per frame
+    while (const float* frame = frames.getReadPointer())
+    {
+        if (mode == POWER_LINES)
+        {
+            updatePowerSpectrum (frame, frames.getFrameSize(), channel);
+            lineChanged = true;
+        }
+        else if (mode == SPECTROGRAM_COLUMNS)
+        {
+            addSpectrogramColumn (frame, frames.getFrameSize(), channel);
+        }
+
+        frames.finishedRead();
+    }
+
+    return lineChanged;
+}
+
+bool SpectrumRenderer::consumeCoherence (int pair, FrameFifo& frames)
+{
+    bool lineChanged = false;
+
+    while (const float* frame = frames.getReadPointer())
+    {
+        if (mode == COHERENCE_LINES)
+        {
+            updateCoherence (frame, frames.getFrameSize(), pair);
+            lineChanged = true;
+        }
+
+        frames.finishedRead();
+    }
+
+    return lineChanged;
+}
+
+void SpectrumRenderer::publishLines()
+{
+    const std::vector<std::vector<float>>& values = mode == COHERENCE_LINES ? currCoherence : currPower;
+
+    AtomicScopedWritePtr<Lines> writer (lines);
+
+    if (! writer.isValid())
+        return;
+
+    for (int i = 0; i < values.size(); i++)
+        std::copy (values[i].begin(), values[i].end(), writer->values[i].begin());
+
+    writer->maxPower = maxPower;
+    writer.pushUpdate();
+}
+
+void SpectrumRenderer::discardOutput()
+{
+    if (lines.hasUpdate())
+    {
+        AtomicScopedReadPtr<Lines> discarded (lines);
+    }
+
+    for (auto& queue : columns)
+    {
+        while (queue->getReadPointer() != nullptr)
+            queue->finishedRead();
+    }
+}
+
+void SpectrumRenderer::updatePowerSpectrum (const float* powerData, int numFreqs, int channel)
+{
+    if (channel >= smoother.getNumChannels() || numFreqs != currPower[channel].size())
+        return;
+
+    // the frame is filtered in the channel's own storage, so the FIFO slot stays untouched
+    std::vector<float>& frame = frameData[channel];
+    std::copy (powerData, powerData + numFreqs, frame.begin());
+
+    // Apply low pass filter for every frequency at once
+    if (smoothOverTime)
+        smoother.filter (channel, frame.data(), numFreqs);
+
+    for (int n = 0; n < numFreqs; n++)
+    {
+        isValid[n] = std::isfinite (frame[n]) && std::isgreaterequal (frame[n], 1.0f);
+
+        // keep the log kernel's input in its domain
+        if (! isValid[n])
+            frame[n] = 1.0f;
+    }
+
+    SpectralKernels::log (frame.data(), powerBuffer.data(), numFreqs);
+
+    for (int n = 0; n < numFreqs; n++)
+    {
+        if (isValid[n])
+        {
+            if (powerBuffer[n] > maxPower)
+                maxPower = powerBuffer[n];
+        }
+        else
+        {
+            powerBuffer[n] = currPower[channel][n];
+        }
+    }
+
+    if (smoothAcrossFrequencies)
+    {
+        // apply smoothing
+        DisplaySmoother::boxcar (powerBuffer.data(), currPower[channel].data(), numFreqs);
+    }
+    else
+    {
+        std::copy (powerBuffer.begin(), powerBuffer.begin() + numFreqs, currPower[channel].begin());
+    }
+}
+
+void SpectrumRenderer::updateCoherence (const float* coherenceData, int numFreqs, int pair)
+{
+    if (pair >= currCoherence.size() || numFreqs != currCoherence[pair].size())
+        return;
+
+    std::copy (coherenceData, coherenceData + numFreqs, currCoherence[pair].begin());
+}
+
+void SpectrumRenderer::addSpectrogramColumn (const float* chanData, int numFreqs, int channel)
+{
+    if (numFreqs <= 0 || channel >= columns.size())
+        return;
+
+    FrameQueue<uint8>& queue = *columns[channel];
+    ColumnScale& scale = columnScales[channel];
+
+    const int numRows = queue.getFrameSize();
+
+    // find the range of values produced, so we can scale our rendering to
+    // show up the detail clearly
+    const auto powerRange = std::minmax_element (chanData, chanData + numFreqs);
+
+    scale.logMax = *powerRange.second > 0.0f ? std::log10 (1.0f + *powerRange.second) : 0.0f;
+    scale.logMin = *powerRange.first > 0.0f ? std::log10 (1.0f + *powerRange.first) : 0.0f;
+    scale.hasFrame = true;
+
+    // every channel shares the scale, so their colours can be compared
+    float logMin = scale.logMin;
+    float logMax = scale.logMax;
+
+    for (const auto& other : columnScales)
+    {
+        if (other.hasFrame)
+        {
+            logMin = jmin (logMin, other.logMin);
+            logMax = jmax (logMax, other.logMax);
+        }
+    }
+
+    logMax = jmax (logMax, 1e-5f);
+
+    const float levelScale = logMax > logMin ? (SPECTROGRAM_LEVELS - 1) / (logMax - logMin) : 0.0f;
+
+    // if the message thread has fallen this far behind, the column is dropped
+    uint8* column = queue.getWritePointer();
+
+    if (column == nullptr)
+        return;
+
+    for (int y = 0; y < numRows; ++y)
+    {
+        const float skewedProportionY = 1.0f - (float) y / (float) numRows;
+        const int dataIndex = jlimit (0, numFreqs - 1, (int) (skewedProportionY * (numFreqs - 1)));
+
+        const float logPower = chanData[dataIndex] > 0.0f ? std::log10 (1.0f + chanData[dataIndex]) : 0.0f;
+
+        column[y] = (uint8) jlimit (0, SPECTROGRAM_LEVELS - 1, roundToInt ((logPower - logMin) * levelScale));
+    }
+
+    queue.finishedWrite();
+}
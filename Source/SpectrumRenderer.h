@@ -0,0 +1,152 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SPECTRUM_RENDERER_H_INCLUDED
+#define SPECTRUM_RENDERER_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include "AtomicSynchronizer.h"
+#include "DisplaySmoother.h"
+#include "FrameFifo.h"
+
+/*
+	Turns the power and coherence frames of one view into what the canvas
+	shows: smoothed log-power or coherence lines, or spectrogram columns of
+	colour levels.
+
+	Frames are consumed on the canvas's render thread; the message thread
+	reads the lines and columns it publishes. All storage is sized by
+	prepare(), so consuming frames, publishing them and reading them back
+	never allocates. Only juce_core is used, so the path can be driven
+	without the GUI.
+*/
+class SpectrumRenderer
+{
+public:
+    /** What the frames are turned into */
+    enum Mode
+    {
+        POWER_LINES,
+        SPECTROGRAM_COLUMNS,
+        COHERENCE_LINES
+    };
+
+    /** Lines published for the message thread */
+    struct Lines
+    {
+        std::vector<std::vector<float>> values; // channels or pairs x freqs
+        float maxPower = 0.0f;
+    };
+
+    /** Constructor */
+    SpectrumRenderer() {}
+
+    /** Destructor */
+    ~SpectrumRenderer() {}
+
+    /** Sizes the lines, filters and spectrogram columns. Column queues are kept when their
+        number of rows does not change. Neither thread may be using the renderer. */
+    void prepare (int numChannels, int numPairs, int numFreqs, int spectrogramRows, bool smoothOverTime, bool smoothAcrossFrequencies);
+
+    /** Sets what the frames are turned into. Neither thread may be using the renderer. */
+    void setMode (Mode newMode) { mode = newMode; }
+
+    /** Clears the filters, lines and colour scale (render thread) */
+    void reset();
+
+    /** Consumes a channel's waiting power frames, returning true if its line changed (render thread) */
+    bool consumePower (int channel, FrameFifo& frames);
+
+    /** Consumes a pair's waiting coherence frames, returning true if its line changed (render thread) */
+    bool consumeCoherence (int pair, FrameFifo& frames);
+
+    /** Hands the current power or coherence lines to the message thread (render thread) */
+    void publishLines();
+
+    /** Lines published by the render thread */
+    AtomicallyShared<Lines>& getLines() { return lines; }
+
+    /** Finished columns of a channel's spectrogram, each a level from 0 to
+        SPECTROGRAM_LEVELS - 1 per row, from the highest frequency down */
+    FrameQueue<uint8>& getColumns (int channel) { return *columns[channel]; }
+
+    /** Discards the lines and columns the message thread has not read yet (message thread) */
+    void discardOutput();
+
+    /** Number of levels of a spectrogram column */
+    static const int SPECTROGRAM_LEVELS = 256;
+
+    /** Columns a spectrogram can hold for the message thread before new ones are dropped */
+    static const int COLUMN_QUEUE_SIZE = 64;
+
+private:
+    /** Smooths and stores the latest power frame of a channel */
+    void updatePowerSpectrum (const float* powerData, int numFreqs, int channel);
+
+    /** Stores the latest coherence frame of a pair */
+    void updateCoherence (const float* coherenceData, int numFreqs, int pair);
+
+    /** Turns a channel's latest power frame into a spectrogram column */
+    void addSpectrogramColumn (const float* powerData, int numFreqs, int channel);
+
+    Mode mode = POWER_LINES;
+
+    bool smoothOverTime = true;
+    bool smoothAcrossFrequencies = true;
+
+    float maxPower = 0.0f;
+
+    std::vector<std::vector<float>> currPower; // channels x freqs
+
+    std::vector<std::vector<float>> currCoherence; // pairs x freqs
+
+    std::vector<std::vector<float>> frameData; // channels x freqs, filtered in place
+
+    std::vector<float> powerBuffer; // log power of the frame being updated
+
+    std::vector<char> isValid; // whether each bin of that frame is finite and >= 1
+
+    /** Low-pass filters each frequency of each channel over time, and smooths across frequencies */
+    DisplaySmoother smoother;
+
+    /** Latest lines, passed from the render thread to the message thread */
+    AtomicallyShared<Lines> lines;
+
+    /** Range of log10 (1 + power) in each channel's newest frame, once there is one */
+    struct ColumnScale
+    {
+        float logMin = 0.0f;
+        float logMax = 0.0f;
+        bool hasFrame = false;
+    };
+
+    std::vector<ColumnScale> columnScales;
+
+    /** Finished spectrogram columns of each channel */
+    std::vector<std::unique_ptr<FrameQueue<uint8>>> columns;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrumRenderer);
+};
+
+#endif // SPECTRUM_RENDERER_H_INCLUDED
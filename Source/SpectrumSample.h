@@ -0,0 +1,47 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SPECTRUM_SAMPLE_H_INCLUDED
+#define SPECTRUM_SAMPLE_H_INCLUDED
+
+/*
+	Precision of the spectral pipeline from the windowed buffers onwards.
+
+	Input samples and displayed powers are always float. Building with the
+	SPECTRUM_VIEWER_SINGLE_PRECISION CMake option also runs the FFTs and
+	averages in float, using FFTW's single-precision library. This halves
+	the memory traffic and doubles the SIMD width. The default build uses
+	double.
+
+	SPECTRUM_FFTW (name) expands to the FFTW function or type of the chosen
+	precision, e.g. SPECTRUM_FFTW (plan) is fftw_plan or fftwf_plan.
+*/
+#if SPECTRUM_VIEWER_SINGLE_PRECISION
+using SpectrumSample = float;
+#define SPECTRUM_FFTW(name) fftwf_##name
+#else
+using SpectrumSample = double;
+#define SPECTRUM_FFTW(name) fftw_##name
+#endif
+
+#endif // SPECTRUM_SAMPLE_H_INCLUDED
@@ -22,27 +22,42 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "SpectrumViewer.h"
+#include "SpectralKernels.h"
 
 #include "SpectrumViewerEditor.h"
 
+#include <algorithm>
+#include <functional>
+
 #define MS_FROM_START Time::highResolutionTicksToSeconds (Time::getHighResolutionTicks() - start) * 1000
 
 SpectrumViewer::SpectrumViewer()
     : GenericProcessor ("Spectrum Viewer"), Thread ("FFT Thread"), displayType (POWER_SPECTRUM)
 {
-    tfrParams.segLen = 1;
-    tfrParams.freqStart = 0;
-    tfrParams.freqEnd = 1000;
     tfrParams.stepLen = 0.020; // update every 20 ms (50 Hz)
-    tfrParams.winLen = 0.25;
     tfrParams.interpRatio = 1;
-    tfrParams.freqStep = 1.0 / float (tfrParams.winLen * tfrParams.interpRatio);
-    tfrParams.nFreqs = int ((tfrParams.freqEnd - tfrParams.freqStart) / tfrParams.freqStep);
     tfrParams.Fs = 2000;
-    tfrParams.alpha = 0;
+    tfrParams.zoom = false;
+    tfrParams.alpha = 1; // show the latest frame; the canvas does the smoothing
+    tfrParams.coherenceAlpha = tfrParams.stepLen / 1.0f; // average cross-spectra over about 1 s
     tfrParams.nTimes = 1;
+    tfrParams.method = CumulativeTFR::PERIODOGRAM;
+    tfrParams.numThreads = 1;
+
+    // the first analysis is prepared right away, so there is always one to show
+    analysis = createAnalysis();
+    prepareAnalysis (*analysis);
+    nextAnalysis = analysis.get();
+    audioAnalysis = analysis.get();
 
     bufferResizer = std::make_unique<BufferResizer> (this);
+
+    decimatedBlock.allocate (SpectrumEngine::MAX_BLOCK_SIZE + 1, true);
+
+    // plans covered by stored wisdom are ready without measuring
+    FFTWPlanner::getInstance().loadWisdom();
+
+    LOGD ("Spectral kernels use ", SpectralKernels::getInstructionSetName());
 }
 
 void SpectrumViewer::registerParameters()
@@ -60,8 +75,66 @@ void SpectrumViewer::registerParameters()
                                   "Channels",
                                   "Channels",
                                   "The channels to analyze",
-                                  MAX_CHANS,
+                                  std::numeric_limits<int>::max(),
                                   false);
+
+    addIntParameter (Parameter::PROCESSOR_SCOPE,
+                     "fft_threads",
+                     "FFT Threads",
+                     "Number of threads used to compute spectra",
+                     jlimit (1, 8, SystemStats::getNumCpus() / 2),
+                     1,
+                     64,
+                     true);
+
+    addStringParameter (Parameter::PROCESSOR_SCOPE,
+                        "coherence_pairs",
+                        "Coherence Pairs",
+                        "Pairs of selected channels to compute coherence for, e.g. 1-2, 1-3",
+                        "1-2",
+                        false);
+
+    addCategoricalParameter (Parameter::PROCESSOR_SCOPE,
+                             "method",
+                             "Method",
+                             "How the power of each frequency is estimated",
+                             { "FFT", "Wavelet", "Sliding DFT", "Multitaper", "Welch", "Constant-Q" },
+                             0,
+                             false);
+
+    addIntParameter (Parameter::PROCESSOR_SCOPE,
+                     "interp_ratio",
+                     "Interp.",
+                     "Zero-padding factor of each window, for a finer frequency step (FFT, Wavelet and Multitaper methods)",
+                     1,
+                     1,
+                     8,
+                     false);
+
+    addStringParameter (Parameter::PROCESSOR_SCOPE,
+                        "sliding_bands",
+                        "SDFT Bands",
+                        "Frequencies (Hz) the sliding DFT method tracks, as single frequencies or ranges, e.g. 6-10, 60, 120",
+                        "6-10, 60, 120, 180",
+                        false);
+
+    addStringParameter (Parameter::PROCESSOR_SCOPE,
+                        "zoom_band",
+                        "Zoom Band",
+                        "Band (Hz) shown when the frequency range is set to Zoom, e.g. 55-65",
+                        "55-65",
+                        false);
+
+    addFloatParameter (Parameter::PROCESSOR_SCOPE,
+                       "zoom_resolution",
+                       "Zoom Res.",
+                       "Frequency resolution when the frequency range is set to Zoom",
+                       "Hz",
+                       0.1f,
+                       0.01f,
+                       10.0f,
+                       0.01f,
+                       false);
 }
 
 AudioProcessorEditor* SpectrumViewer::createEditor()
@@ -84,27 +157,12 @@ void SpectrumViewer::parameterValueChanged (Parameter* param)
         activeStream = getDataStream (streamKey)->getStreamId();
 
         tfrParams.Fs = getDataStream (activeStream)->getSampleRate();
-        tfrParams.freqStep = 1.0 / float (tfrParams.winLen * tfrParams.interpRatio);
-        tfrParams.nFreqs = int ((tfrParams.freqEnd - tfrParams.freqStart) / tfrParams.freqStep);
-
-        int bufferSize = int (tfrParams.Fs * tfrParams.winLen);
-
-        for (int i = 0; i < MAX_CHANS; i++)
-        {
-            powerBuffers[i].setBufferSize (bufferSize, tfrParams.stepLen * tfrParams.Fs);
-            powerBuffers[i].setNumFreqs (tfrParams.nFreqs);
-        }
-
-        bufferResizer->resize();
-
-        resetTFR();
 
         SelectedChannelsParameter* p = (SelectedChannelsParameter*) getDataStream (activeStream)->getParameter ("Channels");
         if (p != nullptr)
-        {
             channels = p->getArrayValue();
-            getEditor()->updateVisualizer();
-        }
+
+        updateEngine();
     }
     else if (param->getName() == "Channels")
     {
@@ -114,144 +172,423 @@ void SpectrumViewer::parameterValueChanged (Parameter* param)
 
         channels = p->getArrayValue();
 
-        getEditor()->updateVisualizer();
+        updateEngine();
+    }
+    else if (param->getName() == "coherence_pairs" || param->getName() == "sliding_bands")
+    {
+        updateEngine();
+    }
+    else if (param->getName() == "fft_threads")
+    {
+        // the batches are sized for the worker pool, which is started with this count
+        updateEngine();
+    }
+    else if (param->getName() == "method")
+    {
+        tfrParams.method = (CumulativeTFR::Method) (int) param->getValue();
+
+        // the frequencies depend on the method
+        updateEngine();
+    }
+    else if (param->getName() == "interp_ratio")
+    {
+        tfrParams.interpRatio = jmax (1, (int) param->getValue());
+
+        updateEngine();
+    }
+    else if (param->getName() == "zoom_band" || param->getName() == "zoom_resolution")
+    {
+        if (tfrParams.zoom)
+            updateEngine();
     }
 }
 
-void SpectrumViewer::setFrequencyRange (Range<int> newRange)
+void SpectrumViewer::setFrequencyRanges (const Array<Range<int>>& ranges)
 {
-    if (newRange.getEnd() != tfrParams.freqEnd)
+    if ((ranges != selectedRanges || tfrParams.zoom) && ! ranges.isEmpty())
     {
-        tfrParams.freqEnd = newRange.getEnd();
+        selectedRanges = ranges;
+        tfrParams.zoom = false;
+
+        updateEngine();
+    }
+}
+
+void SpectrumViewer::setZoom()
+{
+    if (! tfrParams.zoom)
+    {
+        tfrParams.zoom = true;
+
+        updateEngine();
+    }
+}
+
+void SpectrumViewer::updateFrequencyGrids (Analysis& a)
+{
+    const int numViews = a.params.zoom ? 1 : a.ranges.size();
 
-        if (tfrParams.freqEnd == 100)
-            tfrParams.winLen = 2;
-        else if (tfrParams.freqEnd == 500)
-            tfrParams.winLen = 0.5;
-        else if (tfrParams.freqEnd == 1000)
-            tfrParams.winLen = 0.25;
+    a.views.clear();
+
+    for (int v = 0; v < numViews; v++)
+    {
+        auto* view = a.views.add (new SpectrumView());
+        updateFrequencyGrid (a, *view, a.params.zoom ? Range<int>() : a.ranges[v]);
+    }
+}
+
+void SpectrumViewer::updateFrequencyGrid (const Analysis& a, SpectrumView& view, Range<int> range)
+{
+    if (a.params.zoom)
+    {
+        const String& band = a.zoomBand;
+        const float resolution = jmax (0.01f, a.zoomResolution);
+        const float nyquist = a.params.Fs / 2;
+
+        // at least a few bins, so the band stays wider than the resolution, and all of them below Nyquist
+        view.freqStart = jlimit (0.0f, jmax (0.0f, nyquist - 4 * resolution), band.upToFirstOccurrenceOf ("-", false, false).trim().getFloatValue());
+        view.freqEnd = jlimit (view.freqStart, nyquist, band.fromFirstOccurrenceOf ("-", false, false).trim().getFloatValue());
+        view.freqEnd = jmax (view.freqEnd, view.freqStart + 4 * resolution);
+
+        view.winLen = 1 / resolution;
+    }
+    else
+    {
+        view.freqStart = range.getStart();
+        view.freqEnd = range.getEnd();
+
+        if (view.freqEnd == 100)
+            view.winLen = 2;
+        else if (view.freqEnd == 500)
+            view.winLen = 0.5;
+        else if (view.freqEnd == 1000)
+            view.winLen = 0.25;
         else
-            tfrParams.winLen = 0.1;
+            view.winLen = 0.1;
+    }
+}
 
-        tfrParams.freqStep = 1.0 / float (tfrParams.winLen * tfrParams.interpRatio);
-        tfrParams.nFreqs = int ((tfrParams.freqEnd - tfrParams.freqStart) / tfrParams.freqStep);
+void SpectrumViewer::updateFrequencies (const Analysis& a, SpectrumView& view)
+{
+    const CumulativeTFR::Method method = a.params.method;
 
-        int bufferSize = int (tfrParams.Fs * tfrParams.winLen);
+    view.windowSize = roundToInt (view.analysisFs * view.winLen);
 
-        for (int i = 0; i < MAX_CHANS; i++)
-        {
-            powerBuffers[i].setBufferSize (bufferSize, tfrParams.stepLen * tfrParams.Fs);
-            powerBuffers[i].setNumFreqs (tfrParams.nFreqs);
-        }
+    // Padding interpolates the bins of the window's own transform. The sliding DFT tracks the bins
+    // of the window, Welch transforms segments instead, and constant-Q frequencies are not on the bins.
+    const bool padded = method == CumulativeTFR::PERIODOGRAM
+                        || method == CumulativeTFR::WAVELET
+                        || method == CumulativeTFR::MULTITAPER;
+
+    if (method == CumulativeTFR::SLIDING_DFT || method == CumulativeTFR::WELCH)
+        view.fftLen = view.windowSize;
+    else
+        view.fftLen = FFTWPlanner::getFastLength (view.windowSize * (padded ? a.params.interpRatio : 1));
+
+    view.freqStep = view.fftLen > 0 ? view.analysisFs / view.fftLen : 1 / view.winLen;
+
+    if (method == CumulativeTFR::CONSTANT_Q)
+    {
+        // log-spaced from the first frequency above 0 Hz
+        const float lowest = view.freqStart > 0 ? view.freqStart : 1 / view.winLen;
 
-        bufferResizer->resize();
-        resetTFR();
+        view.foi = CumulativeTFR::getConstantQFrequencies (lowest, view.freqEnd);
+        view.nFreqs = (int) view.foi.size();
+    }
+    else
+    {
+        view.nFreqs = roundToInt ((view.freqEnd - view.freqStart) / view.freqStep);
+        view.foi.clear();
 
-        getEditor()->updateVisualizer();
+        for (int freq = 0; freq < view.nFreqs; freq++)
+            view.foi.push_back (view.freqStart + freq * view.freqStep);
     }
 }
 
 void SpectrumViewer::process (AudioBuffer<float>& continuousBuffer)
 {
+    // switch to a new analysis between blocks, publishing it before use so it is not freed meanwhile
+    Analysis* a = nextAnalysis.load();
+
+    while (a != audioAnalysis.load())
+    {
+        audioAnalysis.store (a);
+        a = nextAnalysis.load();
+    }
+
+    // any pointer loaded before this block's switch began is no longer published
+    audioHandoffs.fetch_add (1);
+
     // Nothing to do when no channels selected
-    if (channels.isEmpty())
+    if (a == nullptr || a->channels.isEmpty())
         return;
 
+    const bool zoom = a->params.zoom;
+
     // same number of samples for all channels in stream
     int incomingSampleCount = getNumSamplesInBlock (activeStream);
 
-    //bool updateBuffer = false;
+    // decimate in slices that fit the scratch blocks
+    for (int start = 0; start < incomingSampleCount; start += SpectrumEngine::MAX_BLOCK_SIZE)
+    {
+        const int numSamples = jmin (SpectrumEngine::MAX_BLOCK_SIZE, incomingSampleCount - start);
+
+        if (zoom)
+            a->zoomDemodulator.beginBlock (numSamples);
+
+        // loop over active channels
+        for (int i = 0; i < a->channels.size(); i++)
+        {
+            int globalChanIdx = getGlobalChannelIndex (activeStream, a->channels[i]);
+
+            if (globalChanIdx < 0)
+                continue;
+
+            const float* incomingDataPointer = continuousBuffer.getReadPointer (globalChanIdx) + start;
+
+            if (zoom)
+            {
+                const int numShifted = a->zoomDemodulator.process (i, incomingDataPointer, numSamples, decimatedBlock);
+                a->views[0]->engine.write (i, decimatedBlock, numShifted);
+                continue;
+            }
+
+            // every view reads the level of its own rate
+            a->decimators.process (i, incomingDataPointer, numSamples);
+
+            for (auto* view : a->views)
+                view->engine.write (i, a->decimators.getOutput (view->level), a->decimators.getNumOutputs (view->level));
+        }
+
+        bool stepCompleted = false;
+
+        if (zoom)
+        {
+            stepCompleted = a->views[0]->engine.finishBlock (a->zoomDemodulator.finishBlock (numSamples));
+        }
+        else
+        {
+            a->decimators.finishBlock (numSamples);
+
+            for (auto* view : a->views)
+                stepCompleted = view->engine.finishBlock (a->decimators.getNumOutputs (view->level)) || stepCompleted;
+        }
+
+        if (stepCompleted)
+            stepReady.signal();
+    }
+}
+
+void SpectrumViewer::run()
+{
+    const int64 startTicks = Time::getHighResolutionTicks();
+    int64 busyTicks = 0;
+    int64 numSteps = 0;
+
+    Analysis* previous = nullptr;
 
-    // loop over active channels
-    for (int i = 0; i < channels.size(); i++)
+    while (! threadShouldExit())
     {
-        int globalChanIdx = getGlobalChannelIndex (activeStream, channels[i]);
-        const float* incomingDataPointer = continuousBuffer.getReadPointer (globalChanIdx);
+        // sleep until process() completes a step
+        if (! stepReady.wait (100))
+            continue;
 
-        if (globalChanIdx < 0)
+        const int64 batchStartTicks = Time::getHighResolutionTicks();
+
+        // follow the audio thread, publishing the analysis before use so it is not freed meanwhile
+        Analysis* a;
+
+        do
+        {
+            a = audioAnalysis.load();
+            fftAnalysis.store (a);
+        } while (a != audioAnalysis.load());
+
+        // the analysis it replaced can be freed now, or soon if the audio thread has not moved on yet
+        if (a != previous || retiredAnalysesPending.load())
+        {
+            previous = a;
+            triggerAsyncUpdate();
+        }
+
+        if (a == nullptr)
             continue;
 
-        PowerBuffer* buffer = &powerBuffers[i];
+        currentAnalysis = a;
 
-        // loop over buffers
-        for (int j = 0; j < buffer->incomingSamples.size(); j++)
+        for (auto* view : a->views)
         {
-            AtomicScopedWritePtr<FFTWArrayType> dataWriter (*buffer->incomingSamples[j]);
-            int writeIndex = buffer->writeIndex[j];
+            SpectrumEngine& engine = view->engine;
 
-            //LOGD("Buffer ", j, " write index: ", writeIndex);
+            const int64 written = engine.getTotalSamplesWritten();
+            const int bufferSize = engine.getBufferSize();
+            const int stepSize = engine.getStepSize();
 
-            // Check writer
-            if (! dataWriter.isValid())
+            // if we fell more than a window behind, skip to the most recent step
+            if (written - engine.nextWindowEnd > bufferSize)
             {
-                jassertfalse; // atomic sync data writer broken
+                engine.nextWindowEnd += ((written - engine.nextWindowEnd) / stepSize) * stepSize;
             }
 
-            // loop over samples
-            for (int n = 0; n < incomingSampleCount; n++)
+            currentView = view;
+
+            // compute the steps that are ready, one batch of channels at a time
+            while (engine.nextWindowEnd <= written)
             {
-                writeIndex++;
-
-                if (writeIndex > 0) // make sure we have enough samples
-                {
-                    dataWriter->set (writeIndex - 1, incomingDataPointer[n]);
-                }
-
-                if (writeIndex == buffer->bufferSize)
-                {
-                    // apply window
-
-                    for (int m = 0; m < buffer->bufferSize; m++)
-                    {
-                        dataWriter->set (m, dataWriter->getAsReal (m) * buffer->window[m]);
-                    }
-                    dataWriter.pushUpdate();
-                    //LOGD("Buffer ", j, " is full.");
-                    writeIndex = -5 * buffer->stepSize; // loop around to the beginning
-                    break;
-                }
-            }
+                workerPool.run (this, view->TFR->getNumBatches());
+
+                computeCoherence (*a, *view);
 
-            buffer->writeIndex.set (j, writeIndex);
+                engine.nextWindowEnd += stepSize;
+                numSteps++;
+            }
         }
+
+        busyTicks += Time::getHighResolutionTicks() - batchStartTicks;
+    }
+
+    fftAnalysis.store (nullptr);
+
+    const double totalSeconds = Time::highResolutionTicksToSeconds (Time::getHighResolutionTicks() - startTicks);
+
+    // wall time spent computing steps, workers included. The CPU used between steps is
+    // measured by Benchmarks/SchedulerIdleBenchmark.cpp instead (about 0.1 % of one core).
+    if (totalSeconds > 0)
+    {
+        LOGD ("FFT thread was busy for ", 100.0 * Time::highResolutionTicksToSeconds (busyTicks) / totalSeconds, "% of ", totalSeconds, " s (", numSteps, " steps)");
     }
 }
 
-void SpectrumViewer::run()
+void SpectrumViewer::processTask (int batch, int worker)
 {
-    while (! threadShouldExit())
+    SpectrumView& view = *currentView;
+    SpectrumEngine& engine = view.engine;
+    CumulativeTFR* TFR = view.TFR.get();
+
+    const CumulativeTFR::Method method = currentAnalysis->params.method;
+
+    const int firstChannel = batch * TFR->getChannelsPerBatch();
+    const int numChannels = jmin (TFR->getChannelsPerBatch(), engine.getNumChannels() - firstChannel);
+
+    if (method == CumulativeTFR::SLIDING_DFT)
     {
-        // loop over active channels
-        for (int i = 0; i < channels.size(); i++)
+        for (int i = 0; i < numChannels; i++)
+        {
+            view.windowIsValid[firstChannel + i] = slideWindow (view, firstChannel + i);
+        }
+    }
+    else if (method == CumulativeTFR::WELCH)
+    {
+        for (int i = 0; i < numChannels; i++)
         {
-            PowerBuffer* buffer = &powerBuffers[i];
+            view.windowIsValid[firstChannel + i] = addWelchSegments (view, firstChannel + i);
+        }
 
-            // loop over buffers
-            for (int j = 0; j < buffer->incomingSamples.size(); j++)
-            {
-                if (buffer->incomingSamples[j]->hasUpdate())
-                {
-                    //LOGD("Buffer ", j, " has update.");
+        TFR->computeWelch (batch, engine.nextWindowEnd);
+    }
+    else
+    {
+        for (int i = 0; i < numChannels; i++)
+        {
+            view.windowIsValid[firstChannel + i] = engine.readWindow (firstChannel + i, engine.nextWindowEnd, TFR->getInputRow (firstChannel + i));
+        }
 
-                    AtomicScopedReadPtr<FFTWArrayType> fftReader (*buffer->incomingSamples[j]);
-                    AtomicScopedWritePtr<FFTWArrayType> fftWriter (*buffer->incomingSamples[j]);
-                    AtomicScopedWritePtr<std::vector<float>> powerWriter (*buffer->power[j]);
+        TFR->computeFFT (batch);
+    }
 
-                    if (fftReader.isValid() && fftWriter.isValid() && powerWriter.isValid())
-                    {
-                        fftReader.pullUpdate();
+    for (int i = 0; i < numChannels; i++)
+    {
+        if (! view.windowIsValid[firstChannel + i])
+            continue;
 
-                        TFR->computeFFT (fftWriter.operator*(), i);
-                        TFR->getPower (powerWriter.operator*(), i);
+        FrameFifo* power = engine.getPower (firstChannel + i);
+        float* powerWriter = power->getWritePointer();
 
-                        powerWriter.pushUpdate();
+        // canvas is not keeping up, drop this frame
+        if (powerWriter == nullptr)
+            continue;
 
-                        //LOGD("Buffer ", j, " computed FFT.");
-                    }
-                }
-            }
+        TFR->getPower (powerWriter, firstChannel + i);
+
+        power->finishedWrite();
+    }
+}
+
+bool SpectrumViewer::slideWindow (SpectrumView& view, int channel)
+{
+    SpectrumEngine& engine = view.engine;
+    CumulativeTFR* TFR = view.TFR.get();
+
+    const int64 windowEnd = engine.nextWindowEnd;
+    const int windowSize = engine.getBufferSize();
+    const int numNew = TFR->getSlideLength (channel, windowEnd);
+
+    SpectrumSample* row = TFR->getInputRow (channel);
+
+    if (numNew > 0)
+    {
+        // samples entering the window, then the ones leaving it
+        if (engine.readSamples (channel, windowEnd - numNew, numNew, row)
+            && engine.readSamples (channel, windowEnd - numNew - windowSize, numNew, row + numNew))
+        {
+            TFR->slideWindow (channel, windowEnd, row, row + numNew, numNew);
+            return true;
         }
     }
+    else if (engine.readSamples (channel, windowEnd - windowSize, windowSize, row))
+    {
+        TFR->slideWindow (channel, windowEnd, row, nullptr, windowSize);
+        return true;
+    }
+
+    TFR->resetSlidingDFT (channel);
+    return false;
+}
+
+bool SpectrumViewer::addWelchSegments (SpectrumView& view, int channel)
+{
+    CumulativeTFR* TFR = view.TFR.get();
+
+    const int64 windowEnd = view.engine.nextWindowEnd;
+    SpectrumSample* row = TFR->getInputRow (channel);
+
+    // segments shared with earlier windows were already transformed
+    for (int64 start = TFR->getNextSegment (channel, windowEnd); start >= 0; start = TFR->getNextSegment (channel, windowEnd))
+    {
+        if (! view.engine.readSamples (channel, start, TFR->getSegmentLength(), row))
+        {
+            TFR->resetWelch (channel);
+            return false;
+        }
+
+        TFR->addSegment (channel, start);
+    }
+
+    return true;
+}
+
+void SpectrumViewer::computeCoherence (Analysis& a, SpectrumView& view)
+{
+    for (int pair = 0; pair < view.TFR->getNumPairs(); pair++)
+    {
+        // a channel whose window was overwritten still holds its previous spectrum, which must
+        // not be averaged into the cross-spectra again
+        if (! view.windowIsValid[a.coherencePairs[pair].first] || ! view.windowIsValid[a.coherencePairs[pair].second])
+            continue;
+
+        view.TFR->computeCrossSpectrum (pair);
+
+        FrameFifo* coherence = view.engine.getCoherence (pair);
+        float* coherenceWriter = coherence->getWritePointer();
+
+        // canvas is not keeping up, drop this frame
+        if (coherenceWriter == nullptr)
+            continue;
+
+        view.TFR->getCoherence (coherenceWriter, pair);
+
+        coherence->finishedWrite();
+    }
 }
 
 void SpectrumViewer::updateSettings()
@@ -262,18 +599,276 @@ void SpectrumViewer::updateSettings()
     }
 }
 
-void SpectrumViewer::resetTFR()
+void SpectrumViewer::updateEngine()
 {
-    TFR.reset (new CumulativeTFR (MAX_CHANS, // channel count
-                                  tfrParams.nFreqs,
-                                  tfrParams.nTimes,
-                                  tfrParams.Fs, // sample rate
-                                  tfrParams.winLen,
-                                  tfrParams.stepLen,
-                                  tfrParams.freqStep,
-                                  tfrParams.freqStart,
-                                  tfrParams.segLen, //fftSec
-                                  tfrParams.alpha));
+    auto requested = createAnalysis();
+
+    {
+        const ScopedLock lock (analysisLock);
+
+        // a request that has not been started yet is simply replaced
+        requestedAnalysis = std::move (requested);
+    }
+
+    bufferResizer->resize();
+}
+
+std::unique_ptr<SpectrumViewer::Analysis> SpectrumViewer::createAnalysis()
+{
+    auto a = std::make_unique<Analysis>();
+
+    a->params = tfrParams;
+    a->channels = channels;
+    a->ranges = selectedRanges;
+
+    // parameters are only read here, on the message thread
+    if (Parameter* param = getParameter ("zoom_band"))
+        a->zoomBand = param->getValueAsString();
+
+    if (Parameter* param = getParameter ("zoom_resolution"))
+        a->zoomResolution = (float) param->getValue();
+
+    if (Parameter* param = getParameter ("sliding_bands"))
+        a->slidingBands = param->getValueAsString();
+
+    if (Parameter* param = getParameter ("coherence_pairs"))
+        a->coherencePairsText = param->getValueAsString();
+
+    if (Parameter* param = getParameter ("fft_threads"))
+        a->params.numThreads = jmax (1, (int) param->getValue());
+
+    return a;
+}
+
+bool SpectrumViewer::prepareRequestedAnalysis()
+{
+    std::unique_ptr<Analysis> next;
+
+    {
+        const ScopedLock lock (analysisLock);
+        next = std::move (requestedAnalysis);
+    }
+
+    if (next == nullptr)
+        return false;
+
+    prepareAnalysis (*next);
+
+    {
+        const ScopedLock lock (analysisLock);
+
+        // a prepared analysis that was never installed has not been seen by any other thread
+        preparedAnalysis = std::move (next);
+    }
+
+    triggerAsyncUpdate();
+
+    return true;
+}
+
+void SpectrumViewer::prepareAnalysis (Analysis& a)
+{
+    const int numChannels = a.channels.size();
+
+    updateCoherencePairs (a);
+    updateFrequencyGrids (a);
+
+    if (a.params.zoom)
+    {
+        SpectrumView& view = *a.views[0];
+
+        // analyze the zoom band shifted down to a rate of at least 4 times its width, starting on a bin
+        view.level = -1;
+        view.analysisFs = a.params.Fs / ZoomDemodulator::getFactorFor (a.params.Fs, view.freqEnd - view.freqStart);
+        updateFrequencies (a, view);
+
+        a.zoomDemodulator.prepare (numChannels, a.params.Fs, view.freqStart, view.freqEnd, view.freqStep);
+        a.decimators.prepare (numChannels, a.params.Fs, {});
+        view.analysisStart = a.zoomDemodulator.getShiftedStart();
+    }
+    else
+    {
+        // one level per upper frequency, from the highest down, each at just over 2.5 times that frequency
+        std::vector<float> edges;
+
+        for (auto* view : a.views)
+            edges.push_back (view->freqEnd);
+
+        std::sort (edges.begin(), edges.end(), std::greater<float>());
+        edges.erase (std::unique (edges.begin(), edges.end()), edges.end());
+
+        a.decimators.prepare (numChannels, a.params.Fs, edges);
+
+        for (auto* view : a.views)
+        {
+            view->level = int (std::find (edges.begin(), edges.end(), view->freqEnd) - edges.begin());
+            view->analysisFs = a.decimators.getOutputRate (view->level);
+            view->analysisStart = view->freqStart;
+
+            updateFrequencies (a, *view);
+        }
+
+        LOGD ("Decimating to ", a.decimators.getNumLevels(), " rates with ", a.decimators.getTapsPerInputSample(), " taps per input sample");
+    }
+
+    for (auto* view : a.views)
+    {
+        updateSlidingBins (a, *view);
+
+        view->windowIsValid.allocate (jmax (1, numChannels), true);
+
+        SpectrumEngine& engine = view->engine;
+
+        engine.setNumChannels (numChannels);
+        engine.setNumPairs ((int) a.coherencePairs.size());
+        // a narrow zoom band can decimate below one sample per step
+        engine.setBufferSize (view->windowSize, jmax (1, int (a.params.stepLen * view->analysisFs)));
+        engine.setNumFreqs (view->nFreqs);
+        engine.setWindowed (a.params.method == CumulativeTFR::PERIODOGRAM);
+
+        engine.resize();
+        engine.reset();
+    }
+
+    resetTFR (a);
+}
+
+void SpectrumViewer::resetTFR (Analysis& a)
+{
+    for (auto* view : a.views)
+    {
+        std::vector<float> constantQFreqs;
+
+        // the zoom band is analyzed shifted down by freqStart - analysisStart
+        if (a.params.method == CumulativeTFR::CONSTANT_Q)
+        {
+            for (float hz : view->foi)
+                constantQFreqs.push_back (hz - view->freqStart + view->analysisStart);
+        }
+
+        view->TFR.reset (new CumulativeTFR (view->engine.getNumChannels(), // channel count
+                                            view->nFreqs,
+                                            a.params.nTimes,
+                                            view->analysisFs, // sample rate after decimation
+                                            view->fftLen,
+                                            view->windowSize,
+                                            view->winLen,
+                                            a.params.stepLen,
+                                            view->freqStep,
+                                            view->analysisStart, // first frequency, as analyzed
+                                            a.params.alpha,
+                                            a.coherencePairs,
+                                            a.params.coherenceAlpha,
+                                            a.params.method,
+                                            view->slidingBins,
+                                            constantQFreqs,
+                                            a.params.numThreads)); // one batch or more per FFT thread
+    }
+}
+
+void SpectrumViewer::handleAsyncUpdate()
+{
+    std::unique_ptr<Analysis> prepared;
+
+    {
+        const ScopedLock lock (analysisLock);
+        prepared = std::move (preparedAnalysis);
+    }
+
+    if (prepared != nullptr)
+    {
+        retiredAnalyses.add (analysis.release());
+        analysis = std::move (prepared);
+
+        nextAnalysis.store (analysis.get());
+
+        Analysis* retired = retiredAnalyses.getLast();
+        retired->retiredAt = audioHandoffs.load();
+
+        // without acquisition, the audio thread has nothing to finish
+        if (! isThreadRunning())
+            audioAnalysis.store (analysis.get());
+
+        if (getEditor() != nullptr)
+            getEditor()->updateVisualizer();
+    }
+
+    freeRetiredAnalyses();
+}
+
+void SpectrumViewer::freeRetiredAnalyses()
+{
+    // The audio thread may have loaded a retired analysis from nextAnalysis just before it was
+    // replaced, and still publish it in audioAnalysis, where the FFT thread could pick it up.
+    // A switch that starts after the replacement cannot load it, so once two more switches have
+    // finished, a retired analysis that is in neither slot can never be published again.
+    const bool audioRunning = isThreadRunning();
+    const uint32 handoffs = audioHandoffs.load();
+
+    for (int i = retiredAnalyses.size(); --i >= 0;)
+    {
+        Analysis* retired = retiredAnalyses[i];
+
+        if (audioRunning && handoffs - retired->retiredAt < 2)
+            continue;
+
+        if (retired != nextAnalysis.load() && retired != audioAnalysis.load() && retired != fftAnalysis.load())
+            retiredAnalyses.remove (i);
+    }
+
+    retiredAnalysesPending.store (audioRunning && ! retiredAnalyses.isEmpty());
+}
+
+void SpectrumViewer::updateCoherencePairs (Analysis& a)
+{
+    a.coherencePairs.clear();
+
+    // pairs are written as 1-based positions in the channel selection, e.g. "1-2, 1-3"
+    StringArray tokens = StringArray::fromTokens (a.coherencePairsText, ",;", "");
+
+    for (auto& token : tokens)
+    {
+        if (! token.containsChar ('-'))
+            continue;
+
+        const int first = token.upToFirstOccurrenceOf ("-", false, false).trim().getIntValue() - 1;
+        const int second = token.fromFirstOccurrenceOf ("-", false, false).trim().getIntValue() - 1;
+
+        if (first < 0 || second < 0 || first >= a.channels.size() || second >= a.channels.size() || first == second)
+            continue;
+
+        a.coherencePairs.push_back ({ first, second });
+    }
+}
+
+void SpectrumViewer::updateSlidingBins (const Analysis& a, SpectrumView& view)
+{
+    view.slidingBins.clear();
+
+    if (view.freqStep <= 0)
+        return;
+
+    // single frequencies or ranges in Hz, e.g. "6-10, 60, 120", rounded to the nearest bins
+    StringArray tokens = StringArray::fromTokens (a.slidingBands, ",;", "");
+
+    for (auto& token : tokens)
+    {
+        const float low = token.upToFirstOccurrenceOf ("-", false, false).trim().getFloatValue();
+        const float high = token.containsChar ('-') ? token.fromFirstOccurrenceOf ("-", false, false).trim().getFloatValue() : low;
+
+        const int firstBin = jmax (0, roundToInt ((low - view.freqStart) / view.freqStep));
+        const int lastBin = jmin (view.nFreqs - 1, roundToInt ((high - view.freqStart) / view.freqStep));
+
+        for (int bin = firstBin; bin <= lastBin; bin++)
+            view.slidingBins.push_back (bin);
+    }
+}
+
+String SpectrumViewer::getPairName (int pairIndex)
+{
+    const auto& pair = analysis->coherencePairs[pairIndex];
+
+    return getChanName (analysis->channels[pair.first]) + " - " + getChanName (analysis->channels[pair.second]);
 }
 
 bool SpectrumViewer::streamExists (uint16 streamId)
@@ -289,7 +884,7 @@ bool SpectrumViewer::streamExists (uint16 streamId)
 
 Array<int> SpectrumViewer::getActiveChans()
 {
-    return channels;
+    return analysis->channels;
 }
 
 const String SpectrumViewer::getChanName (int localIdx)
@@ -301,13 +896,19 @@ bool SpectrumViewer::startAcquisition()
 {
     if (isEnabled)
     {
-        bufferResizer->waitForThreadToExit (5000);
+        // start from the latest analysis, with empty buffers
+        Analysis* a = nextAnalysis.load();
+        audioAnalysis.store (a);
 
-        for (int i = 0; i < MAX_CHANS; i++)
-        {
-            powerBuffers[i].reset();
-        }
+        freeRetiredAnalyses();
 
+        for (auto* view : a->views)
+            view->engine.reset();
+
+        a->decimators.reset();
+        a->zoomDemodulator.reset();
+
+        workerPool.start ((int) getParameter ("fft_threads")->getValue());
         startThread();
     }
     return isEnabled;
@@ -315,29 +916,42 @@ bool SpectrumViewer::startAcquisition()
 
 bool SpectrumViewer::stopAcquisition()
 {
+    signalThreadShouldExit();
+    stepReady.signal();
+
     stopThread (1000);
+    workerPool.stop();
+
+    freeRetiredAnalyses();
     return true;
 }
 
 BufferResizer::BufferResizer (SpectrumViewer* p)
     : Thread ("Spectrum Viewer buffer resizer"), processor (p)
 {
-    //setStatusMessage("Resizing buffers...");
+    startThread();
 }
 
-void BufferResizer::resize()
+BufferResizer::~BufferResizer()
 {
-    waitForThreadToExit (5000);
+    signalThreadShouldExit();
+    notify();
+    stopThread (5000);
+}
 
-    run();
+void BufferResizer::resize()
+{
+    notify();
 }
 
 void BufferResizer::run()
 {
-    //setStatusMessage("Resizing data buffer for all channels");
-
-    for (int i = 0; i < MAX_CHANS; i++)
+    while (! threadShouldExit())
     {
-        processor->powerBuffers[i].resize();
+        while (processor->prepareRequestedAnalysis())
+        {
+        }
+
+        wait (-1);
     }
-}
\ No newline at end of file
+}
@@ -28,7 +28,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "AtomicSynchronizer.h"
 #include "CumulativeTFR.h"
+#include "DecimatorCascade.h"
+#include "FFTWorkerPool.h"
+#include "FrameNotifier.h"
+#include "SpectrumEngine.h"
+#include "ZoomDemodulator.h"
 
+#include <atomic>
 #include <chrono>
 #include <ctime>
 #include <fstream>
@@ -36,30 +42,77 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <time.h>
 #include <vector>
 
-#define MAX_CHANS 8
-
 enum DisplayType
 {
     POWER_SPECTRUM = 1,
-    SPECTROGRAM = 2
+    SPECTROGRAM = 2,
+    COHERENCE = 3
 };
 
 class SpectrumViewer;
 
 /*
-	Resize data and power buffers, and show a progress window
+	One frequency range analyzed for the selected channels: its frequency
+	grid, and the sample rings and transforms at the rate it is analyzed at
+*/
+struct SpectrumView
+{
+    // Window length, in seconds
+    float winLen = 0.25f;
+
+    // Number of freq of interest
+    int nFreqs = 0;
+    float freqStep = 4;
+    float freqStart = 0;
+    float freqEnd = 1000;
+
+    // displayed frequencies (freqStart + i * freqStep, or log-spaced for the constant-Q method)
+    std::vector<float> foi;
+
+    // frequency at which freqStart appears in the analyzed signal, which differs when zoomed
+    float analysisStart = 0;
+
+    // sample rate after decimation, which the engine and TFR work at
+    float analysisFs = 0;
+
+    // samples per window, and the zero-padded transform length that sets freqStep (analysisFs / fftLen)
+    int windowSize = 0;
+    int fftLen = 0;
+
+    // level of the decimator cascade that feeds this view, or -1 for the zoom demodulator
+    int level = 0;
+
+    /** Sample rings and power frames for the selected channels */
+    SpectrumEngine engine;
+
+    std::unique_ptr<CumulativeTFR> TFR;
+
+    /** Bins tracked by the sliding DFT method */
+    std::vector<int> slidingBins;
+
+    /** Whether each channel's window was read intact for the current step */
+    HeapBlock<bool> windowIsValid;
+};
+
+/*
+	Allocates the buffers and transforms of new analyses in the background,
+	so settings can change during acquisition without blocking the message
+	thread or the audio thread
 */
 class BufferResizer : public Thread
 {
 public:
-    /** Constructor */
+    /** Constructor, starts the thread */
     BufferResizer (SpectrumViewer* processor);
 
-    /** Resizes buffer */
+    /** Destructor, stops the thread */
+    ~BufferResizer();
+
+    /** Wakes the thread to prepare the latest requested analysis */
     void resize();
 
 private:
-    /** Resizes buffer in the background */
+    /** Prepares requested analyses until there are none left, then waits for the next request */
     void run() override;
 
     /** Pointer to processor */
@@ -75,7 +128,9 @@ private:
 
 */
 class SpectrumViewer : public GenericProcessor,
-                       public Thread
+                       public Thread,
+                       public FFTWorkerPool::Job,
+                       public AsyncUpdater
 {
 public:
     /** Constructor */
@@ -102,189 +157,72 @@ public:
     /** Stop FFT calculation thread*/
     bool stopAcquisition() override;
 
-    /** Run FFT calculation in a separate thread */
+    /** Schedules an FFT batch for every step that is ready */
     void run() override;
 
+    /** Computes the spectra of one batch of channels for the current step (FFT worker threads) */
+    void processTask (int batch, int worker) override;
+
     /** Called when parameter value is updated*/
     void parameterValueChanged (Parameter* param) override;
 
-    /** Called by the canvas to get the number of active chans*/
+    /** Installs the latest prepared analysis and frees the replaced ones that no thread uses anymore (message thread) */
+    void handleAsyncUpdate() override;
+
+    /** Prepares the latest requested analysis, returning false if there was none (buffer resizer thread) */
+    bool prepareRequestedAnalysis();
+
+    /** Called by the canvas to get the channels of the analysis it shows */
     Array<int> getActiveChans();
 
     /** Returns the name of the selected channel at a given index */
     const String getChanName (int localIdx);
 
-    /** Sets the min/max frequency range*/
-    void setFrequencyRange (Range<int>);
+    /** Returns the channel pairs shown in coherence mode, as indices into getActiveChans() */
+    const std::vector<std::pair<int, int>>& getCoherencePairs() const { return analysis->coherencePairs; }
 
-    /** Returns the frequency step for the currently selected range*/
-    float getFreqStep() { return tfrParams.freqStep; };
+    /** Returns a legend label for a coherence pair */
+    String getPairName (int pairIndex);
 
-    /** Holds incoming samples and outgoing powers */
-    struct PowerBuffer
-    {
-        /** Incoming samples for each time step */
-        OwnedArray<AtomicallyShared<FFTWArrayType>> incomingSamples;
-
-        /** Outgoing power for each time step */
-        OwnedArray<AtomicallyShared<std::vector<float>>> power;
-
-        /** Write index */
-        Array<int> writeIndex;
-
-        /** Hamming window to apply to buffer */
-        Array<float> window;
-
-        /** Size of each buffer in samples */
-        int bufferSize = 0;
-
-        /** Step size in samples */
-        int stepSize = 0;
-
-        /** Steps per buffer samples */
-        int stepsPerBuffer = 0;
-
-        /** Number of fft frequencies */
-        int nFreqs;
-
-        /** Keep track of total samples written */
-        long int totalSamplesWritten = 0;
-
-        /** true if buffer size was updated */
-        bool bufferSizeChanged = true;
-
-        /** true if number of freqs was updated */
-        bool numFreqsChanged = true;
-
-        /** Changes buffer size*/
-        void setBufferSize (int bufferSize_, int stepSize_)
-        {
-            if (bufferSize != bufferSize_)
-            {
-                bufferSize = bufferSize_;
-                stepSize = stepSize_;
-                stepsPerBuffer = bufferSize / stepSize;
-                bufferSizeChanged = true;
-            }
-        }
-
-        /** Changes num freqs */
-        void setNumFreqs (int nFreqs_)
-        {
-            if (nFreqs != nFreqs_)
-            {
-                nFreqs = nFreqs_;
-                numFreqsChanged = true;
-            }
-        }
-
-        /** Resets all shared objects and indices */
-        void reset()
-        {
-            for (int i = 0; i < stepsPerBuffer + 5; i++)
-            {
-                incomingSamples[i]->reset();
-                power[i]->reset();
-                writeIndex.set (i, -1 * i * stepSize);
-                totalSamplesWritten = 0;
-            }
-        }
-
-        /** Resizes all buffers */
-        void resize()
-        {
-            if (bufferSizeChanged)
-            {
-                incomingSamples.clear();
-
-                LOGD ("Creating ", stepsPerBuffer + 5, " sample buffers of length ", bufferSize);
-
-                for (int i = 0; i < stepsPerBuffer + 5; i++)
-                {
-                    incomingSamples.add (new AtomicallyShared<FFTWArrayType>());
-                    incomingSamples.getLast()->map ([=] (FFTWArrayType& arr)
-                                                    { arr.resize (bufferSize); });
-                }
-
-                bufferSizeChanged = false;
-
-                window.clear();
-
-                const float N = float (bufferSize);
-                const float PI = 3.1415926535;
-
-                for (int n = 0; n < bufferSize; n++)
-                {
-                    window.add (0.54 - 0.46 * cos (2 * PI * n / N));
-                }
-            }
-
-            power.clear();
-
-            LOGD ("Creating ", stepsPerBuffer + 5, " power buffers of length ", nFreqs);
-
-            for (int i = 0; i < stepsPerBuffer + 5; i++)
-            {
-                power.add (new AtomicallyShared<std::vector<float>>());
-                power.getLast()->map ([=] (std::vector<float>& arr)
-                                      { arr.resize (nFreqs); });
-            }
-
-            numFreqsChanged = false;
-        }
-    };
+    /** Sets the min/max frequency ranges, each analyzed and shown as its own view */
+    void setFrequencyRanges (const Array<Range<int>>& ranges);
 
-    /** Array of buffers */
-    PowerBuffer powerBuffers[MAX_CHANS];
+    /** Shows the band and resolution set by the zoom parameters instead of a frequency range */
+    void setZoom();
+
+    /** Returns the number of frequency ranges being analyzed */
+    int getNumViews() const { return analysis->views.size(); }
+
+    /** Returns the frequency grid, engine and transforms of a frequency range */
+    SpectrumView& getView (int index) { return *analysis->views[index]; }
+
+    /** Returns how the power of each frequency is estimated */
+    CumulativeTFR::Method getMethod() const { return analysis->params.method; }
 
     /** Type of visualization */
     DisplayType displayType;
 
 private:
-    /** Append FFTWArrays to data buffer */
-    void updateDataBufferSize (int size);
-
-    /** Change the size of the data buffer*/
-    void updateDisplayBufferSize (int newSize);
-
     /** Returns true if a given stream ID is available*/
     bool streamExists (uint16 streamId);
 
-    ScopedPointer<CumulativeTFR> TFR;
+    /** Threads that share the FFTs of each step */
+    FFTWorkerPool workerPool;
+
+    /** Wakes the FFT thread when process() completes a step */
+    FrameNotifier stepReady;
 
     /** Priority from 0 to 10 */
     static const int THREAD_PRIORITY = 5;
 
-    /** Resets buffers*/
-    void resetTFR();
-
-    Array<int> channels;
-    Array<Array<int>> bufferIdx; // channels x stepsPerBuffer
-
-    //int bufferSize;
-    //int stepSize;
-    //int stepsPerBuffer;
-
-    uint16 activeStream = 0;
-
-    int numTrials;
-
-    // This is to store data in case of switch and we wish to retrive old data
-    //AtomicallyShared<Array<FFTWArrayType>> dataBufferII;
-    //Array<AtomicallyShared<FFTWArrayType>> updatedDataBuffer;
-
+    // settings shared by every view
     struct TFRParameters
     {
-        float segLen; // Segment Length
-        float winLen; // Window Length
         float stepLen; // Interval between times of interest
-        int interpRatio; //
+        int interpRatio; // the window is zero-padded to at least this many times its length
 
-        // Number of freq of interest
-        int nFreqs;
-        float freqStep;
-        int freqStart;
-        int freqEnd;
+        // show the zoom band (any start and resolution) instead of ranges starting at 0
+        bool zoom;
 
         // Number of times of interest
         int nTimes;
@@ -292,12 +230,120 @@ private:
         // Fs (sampling rate?)
         float Fs;
 
-        // frequency of interest
-        Array<float> foi;
-
         float alpha;
+
+        // exponential average of the cross-spectra used for coherence
+        float coherenceAlpha;
+
+        // how the power of each frequency is estimated
+        CumulativeTFR::Method method;
+
+        // FFT threads the channel batches are sized for
+        int numThreads;
     };
 
+    /** Everything the audio and FFT threads use for one set of channels, ranges and settings.
+        A new analysis is prepared in the background whenever a setting changes, and the audio
+        thread switches to it between two blocks; the replaced one is freed once no thread uses it. */
+    struct Analysis
+    {
+        // settings, copied from the parameters when the analysis was requested
+        TFRParameters params;
+        Array<int> channels;
+        Array<Range<int>> ranges;
+        String zoomBand;
+        float zoomResolution = 0.1f;
+        String slidingBands;
+        String coherencePairsText;
+
+        // prepared from the settings in the background
+        std::vector<std::pair<int, int>> coherencePairs; // as indices into channels
+        OwnedArray<SpectrumView> views; // one per range, or one for the zoom band
+        DecimatorCascade decimators; // feeds every view at its own rate
+        ZoomDemodulator zoomDemodulator; // feeds the zoom view, in place of the decimators
+
+        uint32 retiredAt = 0; // audioHandoffs when a newer analysis replaced this one (message thread)
+    };
+
+    /** Requests an analysis for the current settings, which is prepared in the background */
+    void updateEngine();
+
+    /** Returns an analysis holding a copy of the current settings (message thread) */
+    std::unique_ptr<Analysis> createAnalysis();
+
+    /** Creates the views, filters, buffers and transforms of an analysis from its settings */
+    void prepareAnalysis (Analysis& a);
+
+    /** Creates the transforms of every view of an analysis */
+    void resetTFR (Analysis& a);
+
+    /** Frees the replaced analyses that neither the audio thread nor the FFT thread can still use (message thread) */
+    void freeRetiredAnalyses();
+
+    /** Updates the cross-spectra of every coherence pair of a view and sends out their coherence (FFT thread) */
+    void computeCoherence (Analysis& a, SpectrumView& view);
+
+    /** Parses the coherence pairs of an analysis against its channels */
+    void updateCoherencePairs (Analysis& a);
+
+    /** Converts the sliding bands of an analysis to bins of a view's frequency grid */
+    void updateSlidingBins (const Analysis& a, SpectrumView& view);
+
+    /** Moves a channel's sliding DFT to the current window, returning false if its samples were overwritten (worker threads) */
+    bool slideWindow (SpectrumView& view, int channel);
+
+    /** Transforms the Welch segments of a channel that are new in the current window, returning false if its samples were overwritten (worker threads) */
+    bool addWelchSegments (SpectrumView& view, int channel);
+
+    /** Creates one view per range of an analysis (or one for the zoom band) and sets their bands */
+    void updateFrequencyGrids (Analysis& a);
+
+    /** Sets the band and window length of a view for a range, or for the zoom band */
+    void updateFrequencyGrid (const Analysis& a, SpectrumView& view, Range<int> range);
+
+    /** Sets the transform length, frequency step and frequencies of a view once its sample rate is known */
+    void updateFrequencies (const Analysis& a, SpectrumView& view);
+
+    /** Analysis shown by the canvas, the latest one prepared (message thread) */
+    std::unique_ptr<Analysis> analysis;
+
+    /** Analyses replaced by a newer one that the audio or FFT thread may still be using (message thread) */
+    OwnedArray<Analysis> retiredAnalyses;
+
+    /** Latest analysis requested but not prepared yet, and latest one prepared but not installed yet */
+    std::unique_ptr<Analysis> requestedAnalysis;
+    std::unique_ptr<Analysis> preparedAnalysis;
+    CriticalSection analysisLock;
+
+    /** Analysis the audio thread switches to at its next block */
+    std::atomic<Analysis*> nextAnalysis { nullptr };
+
+    /** Analysis the audio thread feeds, and the one the FFT thread computes (or nullptr) */
+    std::atomic<Analysis*> audioAnalysis { nullptr };
+    std::atomic<Analysis*> fftAnalysis { nullptr };
+
+    /** Number of blocks at which the audio thread has finished switching to nextAnalysis */
+    std::atomic<uint32> audioHandoffs { 0 };
+
+    /** Set while retired analyses wait for the audio thread, so the FFT thread asks again to free them */
+    std::atomic<bool> retiredAnalysesPending { false };
+
+    /** Analysis and view whose step the FFT workers are computing */
+    Analysis* currentAnalysis = nullptr;
+    SpectrumView* currentView = nullptr;
+
+    /** Frequency ranges shown when not zoomed */
+    Array<Range<int>> selectedRanges { Range<int> (0, 1000) };
+
+    /** Shifted samples of one channel, for one slice of a block (audio thread) */
+    HeapBlock<float> decimatedBlock;
+
+    /** Selected channels, for the next analysis */
+    Array<int> channels;
+
+    uint16 activeStream = 0;
+
+    /** Settings for the next analysis */
     TFRParameters tfrParams;
     std::unique_ptr<BufferResizer> bufferResizer;
 
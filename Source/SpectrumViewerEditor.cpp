@@ -27,7 +27,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "SpectrumViewer.h"
 
 SpectrumViewerEditor::SpectrumViewerEditor (GenericProcessor* p)
-    : VisualizerEditor (p, "Power Spectrum", 220)
+    : VisualizerEditor (p, "Power Spectrum", 600)
 {
     addSelectedStreamParameterEditor (Parameter::PROCESSOR_SCOPE, "active_stream", 15, 28);
     getParameterEditor ("active_stream")->setSize (210, 18);
@@ -35,10 +35,24 @@ SpectrumViewerEditor::SpectrumViewerEditor (GenericProcessor* p)
     addSelectedChannelsParameterEditor (Parameter::STREAM_SCOPE, "Channels", 15, 53);
     getParameterEditor ("Channels")->setSize (210, 18);
 
+    addTextBoxParameterEditor (Parameter::PROCESSOR_SCOPE, "fft_threads", 235, 28);
+
+    addTextBoxParameterEditor (Parameter::PROCESSOR_SCOPE, "coherence_pairs", 235, 78);
+
+    addComboBoxParameterEditor (Parameter::PROCESSOR_SCOPE, "method", 325, 28);
+
+    addTextBoxParameterEditor (Parameter::PROCESSOR_SCOPE, "sliding_bands", 325, 78);
+
+    addTextBoxParameterEditor (Parameter::PROCESSOR_SCOPE, "zoom_band", 415, 28);
+
+    addTextBoxParameterEditor (Parameter::PROCESSOR_SCOPE, "zoom_resolution", 415, 78);
+
+    addTextBoxParameterEditor (Parameter::PROCESSOR_SCOPE, "interp_ratio", 505, 28);
+
     displayType = std::make_unique<ComboBox> ("Display Type");
     displayType->setBounds (15, 78, 100, 18);
     displayType->addListener (this);
-    displayType->addItemList ({ "Power Spectrum", "Spectrogram" }, 1);
+    displayType->addItemList ({ "Power Spectrum", "Spectrogram", "Coherence" }, 1);
     displayType->setSelectedId (1, dontSendNotification);
     addAndMakeVisible (displayType.get());
 
@@ -69,10 +83,6 @@ Visualizer* SpectrumViewerEditor::createNewCanvas()
     auto sp = (SpectrumViewer*) getProcessor();
     auto spectrumCanvas = new SpectrumCanvas (sp);
 
-    // Set frequency range for canvas
-    Range<int> range = freqRanges[frequencyRange->getSelectedItemIndex()];
-    spectrumCanvas->getPlotPtr()->setFrequencyRange (range.getStart(), range.getEnd(), sp->getFreqStep());
-
     // Set display type for canvas
     auto type = (DisplayType) displayType->getSelectedId();
     spectrumCanvas->setDisplayType (type);
@@ -82,13 +92,11 @@ Visualizer* SpectrumViewerEditor::createNewCanvas()
 
 void SpectrumViewerEditor::startAcquisition()
 {
-    frequencyRange->setEnabled (false);
     enable();
 }
 
 void SpectrumViewerEditor::stopAcquisition()
 {
-    frequencyRange->setEnabled (true);
     disable();
 }
 
@@ -107,19 +115,29 @@ void SpectrumViewerEditor::comboBoxChanged (ComboBox* cb)
     }
     else if (cb == frequencyRange.get())
     {
-        Range<int> range = freqRanges[cb->getSelectedItemIndex()];
-
         // Send frequency range update to processor
         auto processor = static_cast<SpectrumViewer*> (getProcessor());
-        processor->setFrequencyRange (range);
 
-        // Send frequency range update to canvas plot
-        if (sc != nullptr)
+        if (cb->getSelectedId() == ZOOM_RANGE_ID)
         {
-            sc->getPlotPtr()->setFrequencyRange (range.getStart(),
-                                                 range.getEnd(),
-                                                 processor->getFreqStep());
+            processor->setZoom();
         }
+        else if (cb->getSelectedId() == ALL_RANGES_ID)
+        {
+            // every range side by side, from one set of decimators
+            Array<Range<int>> ranges;
+
+            for (auto range : freqRanges)
+                ranges.addIfNotAlreadyThere (range);
+
+            processor->setFrequencyRanges (ranges);
+        }
+        else
+        {
+            processor->setFrequencyRanges ({ freqRanges[cb->getSelectedItemIndex()] });
+        }
+
+        // the processor updates the canvas once the new ranges are prepared
     }
 }
 
@@ -133,7 +151,7 @@ void SpectrumViewerEditor::selectedStreamHasChanged()
 
         freqRanges.set (3, Range (0, (int) maxFreq));
 
-        if (frequencyRange->getNumItems() == 4)
+        if (frequencyRange->getNumItems() > 3)
         {
             int selectedId = frequencyRange->getSelectedId();
             frequencyRange->changeItemText (4, "0 - " + String (maxFreq));
@@ -142,9 +160,18 @@ void SpectrumViewerEditor::selectedStreamHasChanged()
             {
                 frequencyRange->setText ("0 - " + String (maxFreq), sendNotification);
             }
+            else if (selectedId == ALL_RANGES_ID)
+            {
+                // the last range follows the new Nyquist frequency
+                comboBoxChanged (frequencyRange.get());
+            }
         }
         else
+        {
             frequencyRange->addItem ("0 - " + String (maxFreq), 4);
+            frequencyRange->addItem ("Zoom", ZOOM_RANGE_ID);
+            frequencyRange->addItem ("All", ALL_RANGES_ID);
+        }
     }
 }
 
@@ -66,6 +66,12 @@ private:
 
     Array<Range<int>> freqRanges;
 
+    /** Frequency range item that shows the band set by the zoom parameters */
+    static const int ZOOM_RANGE_ID = 5;
+
+    /** Frequency range item that shows every range side by side */
+    static const int ALL_RANGES_ID = 6;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrumViewerEditor);
 };
 
@@ -0,0 +1,138 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "ZoomDemodulator.h"
+
+#include <cmath>
+
+int ZoomDemodulator::getFactorFor (float sampleRate, float bandwidth)
+{
+    if (bandwidth <= 0)
+        return 1;
+
+    // prepare() stops from half the output rate minus bandwidth / 2 + resolution, so with a
+    // resolution of at most a quarter of the band, the transition is half the output rate
+    // minus 1.5 times the bandwidth
+    const double minTransitionRate = 2.0 * (1.5 * bandwidth + Decimator::MIN_TRANSITION * sampleRate);
+
+    return Decimator::getFactorForRate (sampleRate, jmax (4.0 * bandwidth, minTransitionRate));
+}
+
+void ZoomDemodulator::prepare (int numChannels, float sampleRate, float bandStart, float bandEnd, float resolution)
+{
+    const float bandwidth = bandEnd - bandStart;
+    const int factor = getFactorFor (sampleRate, bandwidth);
+
+    outputRate = sampleRate / factor;
+
+    // centre the band on a quarter of the output rate, rounded down to a whole bin
+    shiftedStart = jmax (0.0f, std::floor ((outputRate / 4 - bandwidth / 2) / resolution) * resolution);
+
+    const double centre = bandStart - shiftedStart + outputRate / 4;
+    phaseStep = -2 * double_Pi * centre / sampleRate;
+
+    // The band lies within passbandEdge of 0 Hz after mixing. Its image from the real part
+    // would fall within passbandEdge of half the output rate, so the stopband starts before that.
+    const float passbandEdge = bandwidth / 2 + resolution;
+    const float stopbandEdge = outputRate / 2 - passbandEdge;
+
+    realPart.prepare (numChannels, factor, sampleRate, passbandEdge, stopbandEdge);
+    imagPart.prepare (numChannels, factor, sampleRate, passbandEdge, stopbandEdge);
+
+    oscillatorReal.allocate (MAX_BLOCK_SIZE, true);
+    oscillatorImag.allocate (MAX_BLOCK_SIZE, true);
+    mixedReal.allocate (MAX_BLOCK_SIZE, true);
+    mixedImag.allocate (MAX_BLOCK_SIZE, true);
+    decimatedReal.allocate (MAX_BLOCK_SIZE + 1, true);
+    decimatedImag.allocate (MAX_BLOCK_SIZE + 1, true);
+
+    phase = 0;
+    outputPhase = 0;
+
+    LOGD ("Zooming into ", bandStart, " - ", bandEnd, " Hz at ", outputRate, " Hz, shifted to start at ", shiftedStart, " Hz");
+}
+
+void ZoomDemodulator::reset()
+{
+    realPart.reset();
+    imagPart.reset();
+
+    phase = 0;
+    outputPhase = 0;
+}
+
+void ZoomDemodulator::beginBlock (int numSamples)
+{
+    jassert (numSamples <= MAX_BLOCK_SIZE);
+
+    for (int n = 0; n < numSamples; n++)
+    {
+        const double angle = phase + n * phaseStep;
+
+        oscillatorReal[n] = float (2 * std::cos (angle));
+        oscillatorImag[n] = float (2 * std::sin (angle));
+    }
+}
+
+int ZoomDemodulator::process (int channel, const float* input, int numSamples, float* dest)
+{
+    FloatVectorOperations::multiply (mixedReal, input, oscillatorReal, numSamples);
+    FloatVectorOperations::multiply (mixedImag, input, oscillatorImag, numSamples);
+
+    const int numOutputs = realPart.process (channel, mixedReal, numSamples, decimatedReal);
+    imagPart.process (channel, mixedImag, numSamples, decimatedImag);
+
+    // Re ((r + i q) exp (i pi m / 2)) moves the band up by a quarter of the output rate
+    for (int m = 0; m < numOutputs; m++)
+    {
+        switch ((outputPhase + m) & 3)
+        {
+            case 0:
+                dest[m] = decimatedReal[m];
+                break;
+            case 1:
+                dest[m] = -decimatedImag[m];
+                break;
+            case 2:
+                dest[m] = -decimatedReal[m];
+                break;
+            default:
+                dest[m] = decimatedImag[m];
+                break;
+        }
+    }
+
+    return numOutputs;
+}
+
+int ZoomDemodulator::finishBlock (int numSamples)
+{
+    const int numOutputs = realPart.finishBlock (numSamples);
+    imagPart.finishBlock (numSamples);
+
+    outputPhase = (outputPhase + numOutputs) & 3;
+    phase = std::fmod (phase + numSamples * phaseStep, 2 * double_Pi);
+
+    return numOutputs;
+}
@@ -0,0 +1,126 @@
+/*
+------------------------------------------------------------------
+
+This file is part of a plugin for the Open Ephys GUI
+Copyright (C) 2019 Translational NeuroEngineering Laboratory
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef ZOOM_DEMODULATOR_H_INCLUDED
+#define ZOOM_DEMODULATOR_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include "Decimator.h"
+
+/*
+	Shifts a narrow band of every channel down to a low sample rate, so a
+	short FFT resolves it finely (a zoom FFT).
+
+	Each channel is multiplied by a complex oscillator that moves the band
+	to 0 Hz, and the real and imaginary parts are low-pass filtered and
+	decimated with a Decimator each. The complex result is then moved up by
+	a quarter of the output rate and its real part kept, which only takes
+	sign changes. The output is a real signal in which the band starts at
+	getShiftedStart() Hz instead of bandStart, with the same orientation and
+	the same amplitude for tones, so it can be analyzed like any other channel.
+
+	Like Decimator, blocks are processed one channel at a time, between
+	beginBlock() and finishBlock().
+*/
+class ZoomDemodulator
+{
+public:
+    /** Longest block process() accepts; longer blocks must be split by the caller */
+    static const int MAX_BLOCK_SIZE = 8192;
+
+    /** Constructor */
+    ZoomDemodulator() {}
+
+    /** Destructor */
+    ~ZoomDemodulator() {}
+
+    /** Returns the decimation factor for a band of the given width, which keeps
+        the output rate at least 4 times the bandwidth. For narrow bands the rate is
+        higher, so the filters' transition band is at least Decimator::MIN_TRANSITION
+        for any resolution up to a quarter of the bandwidth. */
+    static int getFactorFor (float sampleRate, float bandwidth);
+
+    /** Designs the oscillator and filters for a band and clears the history of every channel.
+        The band is shifted so that it starts at a multiple of resolution, which must be at most
+        a quarter of the bandwidth. */
+    void prepare (int numChannels, float sampleRate, float bandStart, float bandEnd, float resolution);
+
+    /** Clears the history of every channel and restarts the oscillator */
+    void reset();
+
+    /** Computes the oscillator for the next block of every channel (audio thread) */
+    void beginBlock (int numSamples);
+
+    /** Shifts and decimates a block of one channel into dest, which must hold
+        numSamples / factor + 1 samples. Returns the number of samples written (audio thread) */
+    int process (int channel, const float* input, int numSamples, float* dest);
+
+    /** Advances the oscillator and output phase once a block has been processed for all channels,
+        returning the number of samples each channel produced (audio thread) */
+    int finishBlock (int numSamples);
+
+    /** Returns the decimation factor */
+    int getFactor() const { return realPart.getFactor(); }
+
+    /** Returns the sample rate of the output */
+    float getOutputRate() const { return outputRate; }
+
+    /** Returns the frequency of the output at which bandStart appears */
+    float getShiftedStart() const { return shiftedStart; }
+
+    /** Returns the number of filter taps used for each of the real and imaginary parts */
+    int getNumTaps() const { return realPart.getNumTaps(); }
+
+    /** Returns the memory used by each channel, in bytes */
+    size_t getBytesPerChannel() const { return realPart.getBytesPerChannel() + imagPart.getBytesPerChannel(); }
+
+private:
+    Decimator realPart;
+    Decimator imagPart;
+
+    /** 2 cos and 2 sin of the oscillator phase (which runs backwards) for each sample of the current block */
+    HeapBlock<float> oscillatorReal;
+    HeapBlock<float> oscillatorImag;
+
+    /** One channel's block after mixing, and after decimation */
+    HeapBlock<float> mixedReal;
+    HeapBlock<float> mixedImag;
+    HeapBlock<float> decimatedReal;
+    HeapBlock<float> decimatedImag;
+
+    /** Oscillator phase at the start of the next block, and its step per sample, in radians */
+    double phase = 0;
+    double phaseStep = 0;
+
+    /** Index of the next output sample, modulo 4 */
+    int outputPhase = 0;
+
+    float outputRate = 0;
+    float shiftedStart = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ZoomDemodulator);
+};
+
+#endif // ZOOM_DEMODULATOR_H_INCLUDED